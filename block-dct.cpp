@@ -0,0 +1,293 @@
+#include "block-dct.hpp"
+#include "block-transform.hpp"
+#include "cpu-features.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+// Fixed-point basis scale, as a power of two
+static const int FIXED_SHIFT = 20;
+
+struct DCTTables {
+	double cosines[8][8];       // cos((2n + 1)kπ / 16), exactly as the reference computes it
+	float basis[8][8];          // 0.5 * C(k) * cos((2n + 1)kπ / 16)
+	float basisT[8][8];         // basis, transposed
+	int64_t fixedBasis[8][8];   // basis * 2^FIXED_SHIFT
+
+	DCTTables() {
+		for (int k = 0; k < 8; k++) {
+			double C = (k == 0) ? sqrt(2.0) / 2 : 1;
+
+			for (int n = 0; n < 8; n++) {
+				cosines[k][n] = cos((2*n + 1) * k * M_PI / 16);
+				basis[k][n] = 0.5 * C * cosines[k][n];
+				basisT[n][k] = basis[k][n];
+				fixedBasis[k][n] = llround(0.5 * C * cosines[k][n] * (1 << FIXED_SHIFT));
+			}
+		}
+	}
+};
+
+static const DCTTables &tables() {
+	static DCTTables instance;
+	return instance;
+}
+
+void blockDCTReference(const int f[8][8], int F[8][8]) {
+	double G[8][8] = {0};
+
+	// Compute the G DCT coefficients
+	for (int i = 0; i < 8; i++) {
+		for (int v = 0; v < 8; v++) {
+			double C = 1;
+			double result = 0;
+
+			for (int j = 0; j < 8; j++) {
+				result += cos((2*j + 1) * v * M_PI / 16) * f[i][j];
+			}
+
+			if (v == 0)
+				C = sqrt(2.0) / 2;
+
+			result *= 0.5 * C;
+
+			G[i][v] = result;
+		}
+	}
+
+	// Compute the F DCT coefficients
+	for (int u = 0; u < 8; u++) {
+		for (int v = 0; v < 8; v++) {
+			double C = 1;
+			double result = 0;
+
+			for (int i = 0; i < 8; i++) {
+				result += cos((2*i + 1) * u * M_PI / 16) * G[i][v];
+			}
+
+			if (u == 0)
+				C = sqrt(2.0) / 2;
+
+			result *= 0.5 * C;
+
+			F[u][v] = round(result);
+		}
+	}
+}
+
+void blockDCTTable(const int f[8][8], int F[8][8]) {
+	// Same operations in the same order as the reference, so the results are
+	// bit-identical (see block-transform.hpp)
+	BlockDCT<8>::transform(f, F);
+}
+
+// Compute the single coefficient F(u,v) with the table kernel's arithmetic
+static int exactCoefficient(const int f[8][8], int u, int v) {
+	const double (*cosines)[8] = tables().cosines;
+	const double C0 = sqrt(2.0) / 2;
+	double result = 0;
+
+	for (int i = 0; i < 8; i++) {
+		double G = 0;
+
+		for (int j = 0; j < 8; j++) {
+			G += cosines[v][j] * f[i][j];
+		}
+
+		G *= 0.5 * (v == 0 ? C0 : 1);
+
+		result += cosines[u][i] * G;
+	}
+
+	result *= 0.5 * (u == 0 ? C0 : 1);
+
+	return round(result);
+}
+
+static void blockDCTFloatScalar(const int f[8][8], int F[8][8]) {
+	const float (*basis)[8] = tables().basis;
+	float G[8][8];
+
+	for (int i = 0; i < 8; i++) {
+		for (int v = 0; v < 8; v++) {
+			float result = 0;
+
+			for (int j = 0; j < 8; j++) {
+				result += basis[v][j] * f[i][j];
+			}
+
+			G[i][v] = result;
+		}
+	}
+
+	for (int u = 0; u < 8; u++) {
+		for (int v = 0; v < 8; v++) {
+			float result = 0;
+
+			for (int i = 0; i < 8; i++) {
+				result += basis[u][i] * G[i][v];
+			}
+
+			float whole = floorf(result);
+			float fraction = result - whole;
+
+			// Too close to halfway to trust the single-precision rounding
+			if (fabsf(fraction - 0.5f) < 1.0f / 32)
+				F[u][v] = exactCoefficient(f, u, v);
+			else
+				F[u][v] = (int)whole + (fraction > 0.5f);
+		}
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+// The float kernel with each row of G and F in one vector. The sums are
+// computed in the same order as the scalar version, so the results are equal.
+TARGET_AVX2 static void blockDCTFloatAVX2(const int f[8][8], int F[8][8]) {
+	const DCTTables &t = tables();
+	__m256 G[8];
+
+	// G(i, v) for all v at once: Σ(j){ f(i,j) * basis(v,j) }
+	for (int i = 0; i < 8; i++) {
+		__m256 result = _mm256_setzero_ps();
+
+		for (int j = 0; j < 8; j++) {
+			__m256 product = _mm256_mul_ps(_mm256_loadu_ps(t.basisT[j]), _mm256_set1_ps((float)f[i][j]));
+			result = _mm256_add_ps(result, product);
+		}
+
+		G[i] = result;
+	}
+
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 margin = _mm256_set1_ps(1.0f / 32);
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	// F(u, v) for all v at once: Σ(i){ basis(u,i) * G(i,v) }
+	for (int u = 0; u < 8; u++) {
+		__m256 result = _mm256_setzero_ps();
+
+		for (int i = 0; i < 8; i++) {
+			__m256 product = _mm256_mul_ps(G[i], _mm256_set1_ps(t.basis[u][i]));
+			result = _mm256_add_ps(result, product);
+		}
+
+		__m256 whole = _mm256_floor_ps(result);
+		__m256 fraction = _mm256_sub_ps(result, whole);
+		__m256 up = _mm256_and_ps(_mm256_cmp_ps(fraction, half, _CMP_GT_OQ), one);
+		__m256 distance = _mm256_and_ps(_mm256_sub_ps(fraction, half), absMask);
+		int uncertain = _mm256_movemask_ps(_mm256_cmp_ps(distance, margin, _CMP_LT_OQ));
+
+		_mm256_storeu_si256((__m256i *)F[u], _mm256_cvttps_epi32(_mm256_add_ps(whole, up)));
+
+		// Too close to halfway to trust the single-precision rounding
+		for (int v = 0; uncertain != 0; v++, uncertain >>= 1) {
+			if (uncertain & 1)
+				F[u][v] = exactCoefficient(f, u, v);
+		}
+	}
+}
+#endif
+
+void blockDCTFloat(const int f[8][8], int F[8][8]) {
+#ifdef HAVE_X86_SIMD
+	if (useAVX2()) {
+		blockDCTFloatAVX2(f, F);
+		return;
+	}
+#endif
+
+	blockDCTFloatScalar(f, F);
+}
+
+void blockDCTFixed(const int f[8][8], int F[8][8]) {
+	const int64_t (*basis)[8] = tables().fixedBasis;
+	const int64_t one = (int64_t)1 << (2 * FIXED_SHIFT);
+	const int64_t half = one / 2;
+	int64_t G[8][8];
+
+	for (int i = 0; i < 8; i++) {
+		for (int v = 0; v < 8; v++) {
+			int64_t result = 0;
+
+			for (int j = 0; j < 8; j++) {
+				result += basis[v][j] * f[i][j];
+			}
+
+			G[i][v] = result;
+		}
+	}
+
+	for (int u = 0; u < 8; u++) {
+		for (int v = 0; v < 8; v++) {
+			int64_t result = 0;
+
+			for (int i = 0; i < 8; i++) {
+				result += basis[u][i] * G[i][v];
+			}
+
+			// Arithmetic shift, so whole is the floor for negative values too
+			int64_t whole = result >> (2 * FIXED_SHIFT);
+			int64_t fraction = result - whole * one;
+
+			// Too close to halfway to trust the quantized basis
+			if (llabs(fraction - half) <= one / 128)
+				F[u][v] = exactCoefficient(f, u, v);
+			else
+				F[u][v] = (int)whole + (fraction > half);
+		}
+	}
+}
+
+void blockDCTBatch(DCTKernel kernel, const int (*f)[8][8], int (*F)[8][8], int count) {
+	// Resolve the kernel (and the SIMD dispatch) once for the whole batch
+	void (*transform)(const int f[8][8], int F[8][8]) = blockDCTTable;
+
+	switch (kernel) {
+		case DCT_KERNEL_REFERENCE:
+			transform = blockDCTReference;
+			break;
+
+		case DCT_KERNEL_TABLE:
+			transform = blockDCTTable;
+			break;
+
+		case DCT_KERNEL_FLOAT:
+			transform = blockDCTFloatScalar;
+#ifdef HAVE_X86_SIMD
+			if (useAVX2())
+				transform = blockDCTFloatAVX2;
+#endif
+			break;
+
+		case DCT_KERNEL_FIXED:
+			transform = blockDCTFixed;
+			break;
+	}
+
+	for (int i = 0; i < count; i++) {
+		transform(f[i], F[i]);
+	}
+}
+
+void blockDCT(DCTKernel kernel, const int f[8][8], int F[8][8]) {
+	switch (kernel) {
+		case DCT_KERNEL_REFERENCE:
+			blockDCTReference(f, F);
+			break;
+
+		case DCT_KERNEL_TABLE:
+			blockDCTTable(f, F);
+			break;
+
+		case DCT_KERNEL_FLOAT:
+			blockDCTFloat(f, F);
+			break;
+
+		case DCT_KERNEL_FIXED:
+			blockDCTFixed(f, F);
+			break;
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef BLOCK_DCT_HPP
+#define BLOCK_DCT_HPP
+
+/*
+ * 8x8 forward DCT kernels for the Task 1 DCT processor.
+ *
+ * From page 8 of "lossy_compression_lectures.pdf":
+ *
+ *  f(i,j) = pixel (i,j)
+ * 	G(i,v) = 0.5 * C(v) * Σ(j=0..7){ cos((2j + 1)vπ / 16) * f(i,j) }
+ * 	F(u,v) = 0.5 * C(u) * Σ(i=0..7){ cos((2i + 1)uπ / 16) * G(i,v) }
+ *
+ *  C(ξ) =  if (ξ = 0) then (√2/2) else (1)
+ *
+ * All kernels take f already normalized to [-128, 127] and produce F rounded
+ * to the nearest integer, with exactly the same values as the reference.
+ *
+ *   - reference: the original loops, calling cos() 1,024 times per block.
+ *   - table:     the same double-precision arithmetic in the same order, with
+ *                the cosines looked up in a precomputed table. Bit-exact.
+ *   - float:     single-precision, with the C(ξ) factors folded into the
+ *                basis table. Uses AVX2 when the CPU supports it.
+ *   - fixed:     integer-only, with the basis scaled by 2^20 and 64 bit
+ *                accumulation.
+ *
+ * The float and fixed kernels are accurate to well within 1/128 of the exact
+ * value, so they can only round differently from the reference when the exact
+ * value is (almost) halfway between two integers. Those coefficients are
+ * recomputed with the table kernel's arithmetic, which makes the output
+ * identical for every block.
+ */
+
+enum DCTKernel {
+	DCT_KERNEL_REFERENCE,
+	DCT_KERNEL_TABLE,
+	DCT_KERNEL_FLOAT,
+	DCT_KERNEL_FIXED
+};
+
+void blockDCTReference(const int f[8][8], int F[8][8]);
+void blockDCTTable(const int f[8][8], int F[8][8]);
+void blockDCTFloat(const int f[8][8], int F[8][8]);
+void blockDCTFixed(const int f[8][8], int F[8][8]);
+
+void blockDCT(DCTKernel kernel, const int f[8][8], int F[8][8]);
+
+// Transform count blocks with the same kernel, e.g. a whole row of blocks
+void blockDCTBatch(DCTKernel kernel, const int (*f)[8][8], int (*F)[8][8], int count);
+
+#endif
@@ -0,0 +1,34 @@
+#include "block-histogram.hpp"
+
+#include <algorithm>
+
+vector<int> histogramBinTable(int offset, int width, int bins) {
+	vector<int> table(256 - offset);
+
+	// With more bins than values (width 0) only the last bin is not empty
+	for (int value = offset; value < 256; value++) {
+		int bin = width > 0 ? (value - offset) / width : bins - 1;
+
+		table[value - offset] = min(bin, bins - 1);
+	}
+
+	return table;
+}
+
+void histogramBlock(const int *pixels, size_t stride, int size, const int *binOf, int bins, int *counts) {
+	fill(counts, counts + bins, 0);
+
+	for (int j = 0; j < size; j++) {
+		const int *row = pixels + j * stride;
+
+		for (int i = 0; i < size; i++) {
+			counts[binOf[row[i]]]++;
+		}
+	}
+}
+
+void histogramBlockRow(const int *pixels, size_t stride, int size, int blocks, const int *binOf, int bins, int *counts) {
+	for (int b = 0; b < blocks; b++) {
+		histogramBlock(pixels + b * size, stride, size, binOf, bins, counts + b * bins);
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef BLOCK_HISTOGRAM_HPP
+#define BLOCK_HISTOGRAM_HPP
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Block histogram kernels for the Task 1 histogram processors.
+ *
+ * The bins are evenly spaced: bin k holds the values in
+ * [offset + k * width, offset + (k + 1) * width), except that the last bin
+ * extends up to 256. Rather than comparing every value against every bin,
+ * the kernels look the bin of each value up in a table built once with
+ * histogramBinTable(), which has one entry per value in [offset, 255]:
+ * 256 entries for pixel values and 511 for frame differences.
+ *
+ *   - pixels:  the top-left value of the block, as 32 bit signed integers
+ *              in [offset, 255]
+ *   - stride:  the distance between rows, in values
+ *   - size:    the width and height of the block
+ *   - binOf:   the table, indexed by value, i.e. table.data() - offset
+ *   - counts:  bins counters, overwritten with the block's histogram
+ *
+ * The row version counts blocks consecutive blocks along a row of blocks,
+ * with the histogram of block b in counts[b * bins .. (b + 1) * bins - 1].
+ */
+
+vector<int> histogramBinTable(int offset, int width, int bins);
+
+void histogramBlock(const int *pixels, size_t stride, int size, const int *binOf, int bins, int *counts);
+void histogramBlockRow(const int *pixels, size_t stride, int size, int blocks, const int *binOf, int bins, int *counts);
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef BLOCK_TRANSFORM_HPP
+#define BLOCK_TRANSFORM_HPP
+
+#include <algorithm>
+#include <cmath>
+
+#include "opencv2/core/core.hpp"
+
+#include "cpu-features.hpp"
+#include "dwt-haar.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * Block transforms of Task 1 for every supported block size: 4x4, 8x8,
+ * 16x16 and 32x32.
+ *
+ * The block size is a template parameter, and every loop below runs to N or
+ * to the size of a Haar level, so each block size gets its own copy of the
+ * code with compile-time trip counts and buffer sizes, which the compiler is
+ * free to unroll.
+ *
+ *   - BlockDCT<N>:          the 2D DCT of an NxN block, generalizing the
+ *                           formula of block-dct.hpp:
+ *
+ *       F(u,v) = √(2/N) * C(u) * Σ(i){ cos((2i + 1)uπ / 2N) * G(i,v) }
+ *       G(i,v) = √(2/N) * C(v) * Σ(j){ cos((2j + 1)vπ / 2N) * f(i,j) }
+ *
+ *                           with the table kernel's double-precision
+ *                           arithmetic; BlockDCT<8> is that kernel.
+ *
+ *   - BlockHaar<N, Levels>: Levels levels of the lifting Haar transform of
+ *                           dwt-haar.hpp on an NxN block, each on the top-left
+ *                           corner left by the previous one, in the
+ *                           transposed layout Task 1 has always stored. The
+ *                           default is every level, down to a single
+ *                           average. The levels are inline copies of
+ *                           haarForward2D and haarInverse2D for a corner of
+ *                           a known size, with the same arithmetic, so the
+ *                           results are identical; 8x8 forward levels use
+ *                           the AVX2 kernel of dwt-haar.cpp where available.
+ *
+ * Only the DCT's cosine table is built at run time, once per block size, on
+ * first use: std::cos can't be evaluated at compile time in C++11, and the
+ * table must hold exactly the values the reference kernel computes.
+ *
+ * The processors pick the instantiation for their block size with
+ * dispatchBlockSize(), which rejects any other size.
+ */
+
+// The block sizes task1 accepts
+inline bool isSupportedBlockSize(int size) {
+	return size == 4 || size == 8 || size == 16 || size == 32;
+}
+
+// Call function.run<N>() for a supported block size N. Any other size is an
+// error (CV_StsBadArg), rather than blocks silently left without features.
+template <typename Function>
+inline void dispatchBlockSize(int size, const Function &function) {
+	switch (size) {
+		case 4:
+			function.template run<4>();
+			break;
+
+		case 8:
+			function.template run<8>();
+			break;
+
+		case 16:
+			function.template run<16>();
+			break;
+
+		case 32:
+			function.template run<32>();
+			break;
+
+		default:
+			CV_Error(CV_StsBadArg, "Unsupported block size, expected 4, 8, 16 or 32");
+	}
+}
+
+// The number of Haar levels of a full NxN block transform: log2(N)
+constexpr int haarLevels(int size) {
+	return size <= 1 ? 0 : 1 + haarLevels(size / 2);
+}
+
+template <int N>
+class BlockDCT {
+
+	public:
+		// f already normalized to [-128, 127], F rounded to the nearest
+		// integer
+		static void transform(const int f[N][N], int F[N][N]) {
+			const double (*cosines)[N] = basis().cosines;
+			const double scale = basis().scale;
+			const double C0 = sqrt(2.0) / 2;
+			double G[N][N];
+
+			for (int i = 0; i < N; i++) {
+				for (int v = 0; v < N; v++) {
+					double result = 0;
+
+					for (int j = 0; j < N; j++) {
+						result += cosines[v][j] * f[i][j];
+					}
+
+					result *= scale * (v == 0 ? C0 : 1);
+
+					G[i][v] = result;
+				}
+			}
+
+			for (int u = 0; u < N; u++) {
+				for (int v = 0; v < N; v++) {
+					double result = 0;
+
+					for (int i = 0; i < N; i++) {
+						result += cosines[u][i] * G[i][v];
+					}
+
+					result *= scale * (u == 0 ? C0 : 1);
+
+					F[u][v] = round(result);
+				}
+			}
+		}
+
+	protected:
+		struct Basis {
+			double cosines[N][N];   // cos((2n + 1)kπ / 2N)
+			double scale;           // √(2/N), exactly 0.5 for N = 8
+
+			Basis() {
+				scale = sqrt(2.0 / N);
+
+				for (int k = 0; k < N; k++) {
+					for (int n = 0; n < N; n++) {
+						cosines[k][n] = cos((2*n + 1) * k * M_PI / (2*N));
+					}
+				}
+			}
+		};
+
+		static const Basis &basis() {
+			static Basis instance;
+			return instance;
+		}
+};
+
+template <int N, int Levels = haarLevels(N)>
+class BlockHaar {
+
+	public:
+		static void forward(float block[N][N]) {
+			Level<N, Levels>::forward(block);
+		}
+
+		static void inverse(float block[N][N]) {
+			Level<N, Levels>::inverse(block);
+		}
+
+	protected:
+		// Transpose the top-left Size x Size corner of the block in place
+		template <int Size>
+		static void transposeCorner(float block[N][N]) {
+			for (int i = 0; i < Size; i++) {
+				for (int j = i + 1; j < Size; j++) {
+					swap(block[i][j], block[j][i]);
+				}
+			}
+		}
+
+		// One level on the top-left Size x Size corner: haarForward2D, for
+		// an even size known at compile time
+		template <int Size>
+		static void forwardCorner(float block[N][N]) {
+			const int half = Size / 2;
+			float differences[half][Size];
+
+#ifdef HAVE_X86_SIMD
+			if (Size == 8 && useAVX2()) {
+				haarForward2D(&block[0][0], N, Size, Size, &differences[0][0]);
+				return;
+			}
+#endif
+
+			// Horizontal pass, the differences of each row kept aside
+			for (int r = 0; r < Size; r++) {
+				for (int i = 0; i < half; i++) {
+					float d = (block[r][2*i] - block[r][2*i + 1]) * 0.5f;
+
+					block[r][i] = block[r][2*i + 1] + d;
+					differences[0][i] = d;
+				}
+
+				for (int i = 0; i < half; i++) {
+					block[r][half + i] = differences[0][i];
+				}
+			}
+
+			// Vertical pass, with the difference rows kept aside
+			for (int i = 0; i < half; i++) {
+				for (int c = 0; c < Size; c++) {
+					float d = (block[2*i][c] - block[2*i + 1][c]) * 0.5f;
+
+					block[i][c] = block[2*i + 1][c] + d;
+					differences[i][c] = d;
+				}
+			}
+
+			for (int i = 0; i < half; i++) {
+				for (int c = 0; c < Size; c++) {
+					block[half + i][c] = differences[i][c];
+				}
+			}
+		}
+
+		// The inverse of forwardCorner: haarInverse2D
+		template <int Size>
+		static void inverseCorner(float block[N][N]) {
+			const int half = Size / 2;
+			float differences[half][Size];
+
+			// Vertical pass, interleaving from the bottom up so that no
+			// average row is overwritten before it is used
+			for (int i = 0; i < half; i++) {
+				for (int c = 0; c < Size; c++) {
+					differences[i][c] = block[half + i][c];
+				}
+			}
+
+			for (int i = half - 1; i >= 0; i--) {
+				for (int c = 0; c < Size; c++) {
+					float a = block[i][c];
+					float d = differences[i][c];
+
+					block[2*i][c] = a + d;
+					block[2*i + 1][c] = a - d;
+				}
+			}
+
+			// Horizontal pass, the same within each row
+			for (int r = 0; r < Size; r++) {
+				for (int i = 0; i < half; i++) {
+					differences[0][i] = block[r][half + i];
+				}
+
+				for (int i = half - 1; i >= 0; i--) {
+					float a = block[r][i];
+					float d = differences[0][i];
+
+					block[r][2*i] = a + d;
+					block[r][2*i + 1] = a - d;
+				}
+			}
+		}
+
+		// The levels from a corner of Size x Size down, Remaining of them
+		template <int Size, int Remaining, bool = (Remaining > 0 && Size > 1)>
+		struct Level {
+			static void forward(float block[N][N]) {
+				forwardCorner<Size>(block);
+				transposeCorner<Size>(block);
+
+				Level<Size / 2, Remaining - 1>::forward(block);
+			}
+
+			static void inverse(float block[N][N]) {
+				Level<Size / 2, Remaining - 1>::inverse(block);
+
+				transposeCorner<Size>(block);
+				inverseCorner<Size>(block);
+			}
+		};
+
+		template <int Size, int Remaining>
+		struct Level<Size, Remaining, false> {
+			static void forward(float block[N][N]) {
+			}
+
+			static void inverse(float block[N][N]) {
+			}
+		};
+};
+
+#endif
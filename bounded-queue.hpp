@@ -0,0 +1,77 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+using namespace std;
+
+/*
+ * A first-in first-out queue between the stages of a pipeline.
+ *
+ * push() blocks while the queue holds capacity items, which is what keeps a
+ * fast stage from running arbitrarily far ahead of a slow one. pop() blocks
+ * while the queue is empty, and returns false once the queue has been closed
+ * and drained. After close(), push() no longer blocks and returns false, so
+ * a producer whose consumer has gone away stops promptly.
+ */
+template <typename T>
+class BoundedQueue {
+
+	public:
+		BoundedQueue(int capacity) {
+			_capacity = max(capacity, 1);
+			_closed = false;
+		}
+
+		bool push(T item) {
+			unique_lock<mutex> lock(_mutex);
+			_notFull.wait(lock, [this]() { return _closed || (int)_items.size() < _capacity; });
+
+			if (_closed)
+				return false;
+
+			_items.push_back(move(item));
+			lock.unlock();
+
+			_notEmpty.notify_one();
+			return true;
+		}
+
+		bool pop(T &item) {
+			unique_lock<mutex> lock(_mutex);
+			_notEmpty.wait(lock, [this]() { return _closed || !_items.empty(); });
+
+			if (_items.empty())
+				return false;
+
+			item = move(_items.front());
+			_items.pop_front();
+			lock.unlock();
+
+			_notFull.notify_one();
+			return true;
+		}
+
+		void close() {
+			{
+				lock_guard<mutex> lock(_mutex);
+				_closed = true;
+			}
+
+			_notFull.notify_all();
+			_notEmpty.notify_all();
+		}
+
+	protected:
+		deque<T> _items;
+		int _capacity;
+		bool _closed;
+		mutex _mutex;
+		condition_variable _notFull;
+		condition_variable _notEmpty;
+};
+
+#endif
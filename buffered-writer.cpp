@@ -0,0 +1,93 @@
+#include "buffered-writer.hpp"
+
+#include <cstring>
+
+BufferedWriter::BufferedWriter(size_t capacity)
+	: _file(NULL)
+	, _buffer(capacity)
+	, _used(0)
+	, _failed(false) {
+}
+
+BufferedWriter::~BufferedWriter() {
+	close();
+}
+
+bool BufferedWriter::open(string filename) {
+	close();
+
+	_file = fopen(filename.c_str(), "wb");
+	_failed = false;
+
+	if (_file == NULL)
+		return false;
+
+	// This buffer replaces the C library's
+	setvbuf(_file, NULL, _IONBF, 0);
+
+	return true;
+}
+
+bool BufferedWriter::isOpen() const {
+	return _file != NULL;
+}
+
+void BufferedWriter::write(const void *data, size_t size) {
+	if (_file == NULL)
+		return;
+
+	if (_used + size > _buffer.size()) {
+		flush();
+
+		// Too large to be worth copying
+		if (size >= _buffer.size()) {
+			if (fwrite(data, 1, size, _file) != size)
+				_failed = true;
+
+			return;
+		}
+	}
+
+	memcpy(_buffer.data() + _used, data, size);
+	_used += size;
+}
+
+void BufferedWriter::write(const string &text) {
+	write(text.data(), text.size());
+}
+
+void BufferedWriter::writeAt(long offset, const void *data, size_t size) {
+	flush();
+
+	if (_file == NULL)
+		return;
+
+	long end = ftell(_file);
+
+	if (end < 0 || fseek(_file, offset, SEEK_SET) != 0 || fwrite(data, 1, size, _file) != size || fseek(_file, end, SEEK_SET) != 0)
+		_failed = true;
+}
+
+bool BufferedWriter::flush() {
+	if (_file == NULL || _used == 0)
+		return !_failed;
+
+	if (fwrite(_buffer.data(), 1, _used, _file) != _used)
+		_failed = true;
+
+	_used = 0;
+	return !_failed;
+}
+
+bool BufferedWriter::close() {
+	if (_file == NULL)
+		return !_failed;
+
+	flush();
+
+	if (fclose(_file) != 0)
+		_failed = true;
+
+	_file = NULL;
+	return !_failed;
+}
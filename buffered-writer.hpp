@@ -0,0 +1,51 @@
+#ifndef BUFFERED_WRITER_HPP
+#define BUFFERED_WRITER_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * An output file with a large user-space buffer.
+ *
+ * Writes are copied into the buffer and only reach the file when the buffer
+ * is full or flush() is called, so writing many small pieces costs one
+ * system call per buffer instead of one per piece. Callers flush at natural
+ * boundaries (the end of a frame) so that complete frames reach the disk
+ * early.
+ *
+ * writeAt() overwrites bytes already written, e.g. to fill in a header
+ * once the total is known.
+ *
+ * A write that doesn't reach the file in full (a full disk, an I/O error)
+ * is remembered: flush() and close() return false from then on, until the
+ * next open(), so callers can check once at the end instead of after every
+ * write.
+ */
+class BufferedWriter {
+
+	public:
+		BufferedWriter(size_t capacity = 1 << 20);
+		~BufferedWriter();
+
+		bool open(string filename);
+		bool isOpen() const;
+
+		void write(const void *data, size_t size);
+		void write(const string &text);
+		void writeAt(long offset, const void *data, size_t size);
+
+		// Return false if any write since open() fell short
+		bool flush();
+		bool close();
+
+	protected:
+		FILE *_file;
+		vector<char> _buffer;
+		size_t _used;
+		bool _failed;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef CPU_FEATURES_HPP
+#define CPU_FEATURES_HPP
+
+/*
+ * Runtime selection of the SIMD kernels.
+ *
+ * The AVX2 kernels are compiled with a per-function target attribute, so the
+ * rest of the program keeps building for the baseline instruction set and
+ * the kernels are only called on CPUs that report AVX2 support. On other
+ * compilers or architectures the scalar kernels are always used.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define HAVE_X86_SIMD
+	#define TARGET_AVX2 __attribute__((target("avx2")))
+	#include <immintrin.h>
+#endif
+
+// Set to false to force the scalar kernels (for example, to compare results)
+inline bool &simdAllowed() {
+	static bool allowed = true;
+	return allowed;
+}
+
+inline bool useAVX2() {
+#ifdef HAVE_X86_SIMD
+	static const bool supported = __builtin_cpu_supports("avx2");
+	return supported && simdAllowed();
+#else
+	return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "dwt-haar.hpp"
+#include "cpu-features.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+size_t haarScratchSize(int width, int height) {
+	// The row pass keeps half a row of differences aside, the column pass
+	// keeps half of the rows of differences aside.
+	return max((size_t)(width/2), (size_t)(height/2) * width);
+}
+
+#ifdef HAVE_X86_SIMD
+// Transpose the 8x8 matrix held in rows r[0..7], one row per vector
+TARGET_AVX2 static inline void transpose8x8(__m256 r[8]) {
+	__m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+	__m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+	__m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+	__m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+	__m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+	__m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+	__m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+	__m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+	__m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+	__m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+	__m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+	r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+	r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+	r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+	r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+	r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+	r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+	r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+	r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+// One lifting step between the vectors of each pair (2i, 2i+1), with the
+// averages moved to the first half and the differences to the second half
+TARGET_AVX2 static inline void liftPairs8(__m256 r[8]) {
+	const __m256 half = _mm256_set1_ps(0.5f);
+	__m256 lifted[8];
+
+	for (int i = 0; i < 4; i++) {
+		__m256 d = _mm256_mul_ps(_mm256_sub_ps(r[2*i], r[2*i + 1]), half);
+
+		lifted[i] = _mm256_add_ps(r[2*i + 1], d);
+		lifted[i + 4] = d;
+	}
+
+	for (int i = 0; i < 8; i++)
+		r[i] = lifted[i];
+}
+
+// A full 8x8 level: transposing turns the horizontal pass into a lifting step
+// between whole vectors, so both passes are done eight lanes at a time with
+// the same arithmetic as the scalar version.
+TARGET_AVX2 static void haarForward8x8AVX2(float *data, size_t stride) {
+	__m256 r[8];
+
+	for (int i = 0; i < 8; i++)
+		r[i] = _mm256_loadu_ps(data + i*stride);
+
+	transpose8x8(r);
+	liftPairs8(r);
+	transpose8x8(r);
+	liftPairs8(r);
+
+	for (int i = 0; i < 8; i++)
+		_mm256_storeu_ps(data + i*stride, r[i]);
+}
+#endif
+
+void haarForward2D(float *data, size_t stride, int width, int height, float *scratch) {
+#ifdef HAVE_X86_SIMD
+	// The 8x8 block DWT of Task 1
+	if (width == 8 && height == 8 && useAVX2()) {
+		haarForward8x8AVX2(data, stride);
+		return;
+	}
+#endif
+
+	int halfw = width/2;
+	int halfh = height/2;
+
+	// Horizontal pass. Only the rows that take part in the vertical pass are
+	// transformed; an odd last row is left untouched.
+	for (int r = 0; r < 2*halfh; r++) {
+		float *row = data + r*stride;
+
+		for (int i = 0; i < halfw; i++) {
+			float d = (row[2*i] - row[2*i + 1]) * 0.5f;
+
+			row[i] = row[2*i + 1] + d;
+			scratch[i] = d;
+		}
+
+		memcpy(row + halfw, scratch, halfw * sizeof(float));
+
+		if (width % 2 != 0)
+			row[width - 1] = 0;
+	}
+
+	// Vertical pass. Row i only depends on rows 2i and 2i+1, so the averages
+	// can be written in place while the differences are kept aside.
+	for (int i = 0; i < halfh; i++) {
+		float *row0 = data + (2*i)*stride;
+		float *row1 = data + (2*i + 1)*stride;
+		float *avg = data + i*stride;
+		float *diff = scratch + i*width;
+
+		for (int c = 0; c < width; c++) {
+			float d = (row0[c] - row1[c]) * 0.5f;
+
+			avg[c] = row1[c] + d;
+			diff[c] = d;
+		}
+	}
+
+	for (int i = 0; i < halfh; i++) {
+		memcpy(data + (i + halfh)*stride, scratch + i*width, width * sizeof(float));
+	}
+}
+
+void haarInverse2D(float *data, size_t stride, int width, int height, float *scratch) {
+	int halfw = width/2;
+	int halfh = height/2;
+
+	// Vertical pass. Keep the difference rows aside, then interleave from the
+	// bottom up so that no average row is overwritten before it is used.
+	for (int i = 0; i < halfh; i++) {
+		memcpy(scratch + i*width, data + (i + halfh)*stride, width * sizeof(float));
+	}
+
+	for (int i = halfh - 1; i >= 0; i--) {
+		float *avg = data + i*stride;
+		float *diff = scratch + i*width;
+		float *row0 = data + (2*i)*stride;
+		float *row1 = data + (2*i + 1)*stride;
+
+		for (int c = 0; c < width; c++) {
+			float a = avg[c];
+			float d = diff[c];
+
+			row0[c] = a + d;
+			row1[c] = a - d;
+		}
+	}
+
+	// Horizontal pass, same idea within each row
+	for (int r = 0; r < 2*halfh; r++) {
+		float *row = data + r*stride;
+
+		memcpy(scratch, row + halfw, halfw * sizeof(float));
+
+		for (int i = halfw - 1; i >= 0; i--) {
+			float a = row[i];
+			float d = scratch[i];
+
+			row[2*i] = a + d;
+			row[2*i + 1] = a - d;
+		}
+	}
+}
+
+void haarForward2D(Mat &matrix, int width, int height, vector<float> &scratch) {
+	CV_Assert(matrix.depth() == CV_32F);
+
+	scratch.resize(max(scratch.size(), haarScratchSize(width, height)));
+	haarForward2D(matrix.ptr<float>(0), matrix.step / sizeof(float), width, height, scratch.data());
+}
+
+void haarInverse2D(Mat &matrix, int width, int height, vector<float> &scratch) {
+	CV_Assert(matrix.depth() == CV_32F);
+
+	scratch.resize(max(scratch.size(), haarScratchSize(width, height)));
+	haarInverse2D(matrix.ptr<float>(0), matrix.step / sizeof(float), width, height, scratch.data());
+}
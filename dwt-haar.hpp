@@ -0,0 +1,46 @@
+#ifndef DWT_HAAR_HPP
+#define DWT_HAAR_HPP
+
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * Lifting-scheme Haar wavelet engine shared by Task 1 (block DWT) and
+ * Task 2 (frame DWT).
+ *
+ * One level of the forward transform on the top-left (width x height) corner
+ * of a matrix replaces each pair of neighbouring samples (x0, x1) with
+ *
+ *      d = (x0 - x1) / 2      (predict)
+ *      a = x1 + d             (update, equal to (x0 + x1) / 2)
+ *
+ * first along every row and then along every column, and stores the averages
+ * in the first half and the differences in the second half of each row and
+ * column. This is exactly the coefficient layout that multiplying by the
+ * Haar matrix and reordering the rows and columns produced, but it costs
+ * O(width * height) instead of a dense matrix product.
+ *
+ * Odd sizes are handled the same way as the matrix formulation: the last
+ * column of the transformed rows is zeroed and the last row is left as is.
+ *
+ * The pointer versions work on float data with a row stride given in floats
+ * and need a scratch buffer of at least haarScratchSize(width, height)
+ * floats, so callers processing many frames or blocks can reuse one buffer.
+ *
+ * Forward transforms of an 8x8 corner use an AVX2 kernel when the CPU
+ * supports it; its results are identical to the scalar version.
+ */
+
+size_t haarScratchSize(int width, int height);
+
+void haarForward2D(float *data, size_t stride, int width, int height, float *scratch);
+void haarInverse2D(float *data, size_t stride, int width, int height, float *scratch);
+
+// Convenience versions for CV_32F matrices; scratch is grown as needed
+void haarForward2D(Mat &matrix, int width, int height, vector<float> &scratch);
+void haarInverse2D(Mat &matrix, int width, int height, vector<float> &scratch);
+
+#endif
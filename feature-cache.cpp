@@ -0,0 +1,354 @@
+#include "feature-cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "log.hpp"
+
+const int featureCodeVersion = 3;
+
+static const char *entryExtension = ".feat";
+static const size_t sampleSize = 1 << 20;
+
+// The extensions of the companion files task3 keeps (see companionPath()),
+// after an underscore and a parameter: a FrameIndex and product quantizer
+// codes
+static const char *companionExtensions[] = {".ivf", ".pq"};
+
+// 64 bit FNV-1a
+static void hashBytes(uint64_t &hash, const void *data, size_t size) {
+	const unsigned char *bytes = (const unsigned char *)data;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+}
+
+static void hashString(uint64_t &hash, const string &value) {
+	uint64_t size = value.size();
+
+	hashBytes(hash, &size, sizeof(size));
+	hashBytes(hash, value.data(), value.size());
+}
+
+static bool hashFileSample(uint64_t &hash, const string &path, uint64_t size) {
+	ifstream file(path, ios::in | ios::binary);
+	vector<char> buffer(sampleSize);
+
+	if (!file.is_open())
+		return false;
+
+	// The first and last megabyte, which overlap for small files
+	uint64_t offsets[2] = {0, size > sampleSize ? size - sampleSize : 0};
+
+	for (int i = 0; i < 2; i++) {
+		file.seekg(offsets[i]);
+		file.read(buffer.data(), buffer.size());
+		hashBytes(hash, buffer.data(), (size_t)file.gcount());
+		file.clear();
+	}
+
+	return true;
+}
+
+static bool copyFile(const string &from, const string &to) {
+	ifstream in(from, ios::in | ios::binary);
+	ofstream out(to, ios::out | ios::binary | ios::trunc);
+
+	if (!in.is_open() || !out.is_open())
+		return false;
+
+	out << in.rdbuf();
+	out.close();
+
+	return !out.fail();
+}
+
+// mkdir -p
+static bool makeDirectories(const string &path) {
+	for (size_t i = 1; i <= path.size(); i++) {
+		if (i < path.size() && path[i] != '/')
+			continue;
+
+		string prefix = path.substr(0, i);
+
+		if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+			return false;
+	}
+
+	return true;
+}
+
+static bool isDigits(const string &text) {
+	return !text.empty() && all_of(text.begin(), text.end(), [](char c) {
+		return c >= '0' && c <= '9';
+	});
+}
+
+// Whether a file in the cache directory is one the cache wrote: a key (16
+// hex digits) followed by the entry extension, or by "_<parameter>" and a
+// companion extension. Nothing else is ever evicted, so a cache directory
+// shared with other files never loses them.
+static bool isCacheFileName(const string &name) {
+	const size_t keyLength = 16;
+
+	if (name.size() <= keyLength || !all_of(name.begin(), name.begin() + keyLength, [](char c) {
+		return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+	}))
+		return false;
+
+	string rest = name.substr(keyLength);
+
+	if (rest == entryExtension)
+		return true;
+
+	for (const char *extension : companionExtensions) {
+		size_t length = strlen(extension);
+
+		if (rest.size() > length + 1 && rest[0] == '_' && rest.compare(rest.size() - length, length, extension) == 0
+				&& isDigits(rest.substr(1, rest.size() - length - 1)))
+			return true;
+	}
+
+	return false;
+}
+
+FeatureCache::FeatureCache() : FeatureCache(defaultDirectory(), defaultCapacity()) {
+}
+
+FeatureCache::FeatureCache(string directory, size_t capacityBytes) {
+	_directory = directory;
+	_capacity = capacityBytes;
+}
+
+string FeatureCache::defaultDirectory() {
+	const char *directory = getenv("FEATURE_CACHE_DIR");
+	const char *home = getenv("HOME");
+
+	if (directory != NULL && directory[0] != '\0')
+		return directory;
+
+	if (home != NULL && home[0] != '\0')
+		return string(home) + "/.cache/phase3-features";
+
+	return ".feature-cache";
+}
+
+size_t FeatureCache::defaultCapacity() {
+	const char *megabytes = getenv("FEATURE_CACHE_MB");
+
+	if (megabytes != NULL && megabytes[0] != '\0')
+		return (size_t)atol(megabytes) << 20;
+
+	return (size_t)1 << 30;
+}
+
+void FeatureCache::disable() {
+	_enabled = false;
+}
+
+bool FeatureCache::isEnabled() const {
+	return _enabled;
+}
+
+string FeatureCache::key(string videoPath, string parameters, string decoder) const {
+	struct stat info;
+
+	if (!_enabled || stat(videoPath.c_str(), &info) != 0)
+		return string();
+
+	uint64_t hash = 14695981039346656037ULL;
+	uint64_t size = info.st_size;
+	int64_t modified = info.st_mtime;
+	int32_t version = featureCodeVersion;
+
+	hashBytes(hash, &size, sizeof(size));
+	hashBytes(hash, &modified, sizeof(modified));
+
+	if (!hashFileSample(hash, videoPath, size))
+		return string();
+
+	hashString(hash, parameters);
+
+	// Keys of the capture's features are left as they were
+	if (!decoder.empty())
+		hashString(hash, decoder);
+	hashBytes(hash, &version, sizeof(version));
+
+	ostringstream out;
+	out << hex << setw(16) << setfill('0') << hash;
+
+	return out.str();
+}
+
+bool FeatureCache::contains(const string &key) const {
+	return _enabled && !key.empty() && access(entryPath(key).c_str(), R_OK) == 0;
+}
+
+bool FeatureCache::load(const string &key, FeatureHeader &header, Mat &features) {
+	if (!_enabled || key.empty())
+		return false;
+
+	string path = entryPath(key);
+
+	if (!readFeatureFile(path, header, features))
+		return false;
+
+	touch(path);
+	LOG(LOG_INFO) << "[*] Read cached features from " << path;
+
+	return true;
+}
+
+bool FeatureCache::map(const string &key, MappedFeatureFile &file) {
+	if (!_enabled || key.empty())
+		return false;
+
+	string path = entryPath(key);
+
+	if (!file.open(path))
+		return false;
+
+	touch(path);
+	LOG(LOG_INFO) << "[*] Mapped cached features from " << path;
+
+	return true;
+}
+
+bool FeatureCache::fetch(const string &key, string filename) {
+	if (!_enabled || key.empty())
+		return false;
+
+	string path = entryPath(key);
+
+	if (!contains(key) || !copyFile(path, filename))
+		return false;
+
+	touch(path);
+	LOG(LOG_INFO) << "[*] Copied cached features from " << path;
+
+	return true;
+}
+
+void FeatureCache::store(const string &key, FeatureType type, int frameWidth, int frameHeight, int blocksX, int blocksY, const Mat &features, const vector<int> &frameNumbers) {
+	if (!_enabled || key.empty() || !prepareDirectory())
+		return;
+
+	string temporary = temporaryPath(key);
+
+	if (!writeFeatureFile(temporary, type, frameWidth, frameHeight, blocksX, blocksY, features, frameNumbers)
+			|| rename(temporary.c_str(), entryPath(key).c_str()) != 0) {
+		remove(temporary.c_str());
+		return;
+	}
+
+	evict();
+}
+
+void FeatureCache::storeFile(const string &key, string filename) {
+	if (!_enabled || key.empty() || !prepareDirectory())
+		return;
+
+	string temporary = temporaryPath(key);
+
+	if (!copyFile(filename, temporary) || rename(temporary.c_str(), entryPath(key).c_str()) != 0) {
+		remove(temporary.c_str());
+		return;
+	}
+
+	evict();
+}
+
+void FeatureCache::evict() {
+	struct Entry {
+		string path;
+		time_t used;
+		size_t size;
+	};
+
+	DIR *directory = opendir(_directory.c_str());
+	vector<Entry> entries;
+	size_t total = 0;
+
+	if (directory == NULL)
+		return;
+
+	while (struct dirent *item = readdir(directory)) {
+		string name = item->d_name;
+		struct stat info;
+
+		// Entries and their companions only: not files still being written,
+		// nor anything else that lives in the directory
+		if (!isCacheFileName(name))
+			continue;
+
+		Entry entry;
+		entry.path = _directory + "/" + name;
+
+		if (stat(entry.path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+			continue;
+
+		entry.used = info.st_mtime;
+		entry.size = info.st_size;
+		entries.push_back(entry);
+		total += entry.size;
+	}
+
+	closedir(directory);
+
+	// Oldest first
+	sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+		return a.used < b.used;
+	});
+
+	for (size_t i = 0; i < entries.size() && total > _capacity; i++) {
+		if (remove(entries[i].path.c_str()) == 0) {
+			total -= entries[i].size;
+			LOG(LOG_DEBUG) << "[*] Evicted cached file " << entries[i].path;
+		}
+	}
+}
+
+string FeatureCache::companionPath(const string &key, string extension) {
+	if (!_enabled || key.empty() || !prepareDirectory())
+		return string();
+
+	return _directory + "/" + key + extension;
+}
+
+string FeatureCache::entryPath(const string &key) const {
+	return _directory + "/" + key + entryExtension;
+}
+
+string FeatureCache::temporaryPath(const string &key) const {
+	return _directory + "/" + key + ".tmp." + to_string(getpid());
+}
+
+bool FeatureCache::prepareDirectory() {
+	if (makeDirectories(_directory))
+		return true;
+
+	LOG(LOG_ERROR) << "[*] ERROR: Couldn't create the feature cache " << _directory << ". Not caching.";
+	_enabled = false;
+
+	return false;
+}
+
+// Mark an entry as just used, for evict()
+void FeatureCache::touch(const string &path) {
+	utime(path.c_str(), NULL);
+}
@@ -0,0 +1,124 @@
+#ifndef FEATURE_CACHE_HPP
+#define FEATURE_CACHE_HPP
+
+#include <string>
+#include "opencv2/core/core.hpp"
+
+#include "feature-file.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * A directory of previously computed feature files, so that asking for the
+ * same features of the same video again reads them back instead of decoding
+ * and transforming the whole video.
+ *
+ * An entry is keyed by:
+ *
+ *   - the video: its size, modification time and a hash of its first and
+ *     last megabyte, so a replaced or edited video misses even if it keeps
+ *     its name;
+ *   - the parameters: the name of the output file the features would be
+ *     written to, which names the feature type and n (or m);
+ *   - the decoder the frames were read with, if not the capture: the Y
+ *     components decoded directly (see luma-decoder.hpp) differ slightly
+ *     from those of the capture, so their features are kept apart;
+ *   - featureCodeVersion, to be bumped whenever a change to the extraction
+ *     changes the features it computes.
+ *
+ * The entries are feature files (see feature-file.hpp), so a task1 or task2
+ * output file can be stored and fetched by copying it. Each hit refreshes the
+ * modification time of its entry, and once the entries take up more than the
+ * capacity, the least recently used ones are removed.
+ *
+ * Entries are written to a temporary file and renamed into place, so several
+ * processes can share a cache directory.
+ *
+ * Files derived from an entry's features, such as a FrameIndex of them, can
+ * be kept next to it under companionPath(). They count towards the capacity
+ * and are evicted like entries.
+ *
+ * Eviction only ever removes files named like the cache's own: entries and
+ * companions with one of the known extensions (see feature-cache.cpp). Any
+ * other file in the directory is left alone and not counted, so pointing
+ * the cache at a directory that holds other files can't delete them.
+ *
+ * Usage:
+ *
+ *   FeatureCache cache;
+ *   string key = cache.key(videoPath, processor->getOutputFileName(), extractionDecoder(options));
+ *
+ *   if (cache.map(key, mapped)) {
+ *       features = mapped.features();
+ *   }
+ *   else if (extractBlockFeatures(processor, capture, options, features)) {
+ *       cache.store(key, type, width, height, blocksX, blocksY, features);
+ *   }
+ */
+
+// Bump whenever the features computed for the same input change
+extern const int featureCodeVersion;
+
+class FeatureCache {
+
+	public:
+		// Defaults to defaultDirectory() and defaultCapacity()
+		FeatureCache();
+		FeatureCache(string directory, size_t capacityBytes);
+
+		// $FEATURE_CACHE_DIR, or ~/.cache/phase3-features
+		static string defaultDirectory();
+
+		// $FEATURE_CACHE_MB megabytes, or 1 GB
+		static size_t defaultCapacity();
+
+		void disable();
+		bool isEnabled() const;
+
+		// The key of the features described by parameters for the video, as
+		// read by decoder (empty for the capture), or an empty string if the
+		// video can't be read
+		string key(string videoPath, string parameters, string decoder = string()) const;
+
+		bool contains(const string &key) const;
+
+		// Read the features of an entry. Returns false on a miss.
+		bool load(const string &key, FeatureHeader &header, Mat &features);
+
+		// Map an entry in place, see MappedFeatureFile. Returns false on a
+		// miss.
+		bool map(const string &key, MappedFeatureFile &file);
+
+		// Copy an entry to a feature file. Returns false on a miss.
+		bool fetch(const string &key, string filename);
+
+		// Add the features as an entry, then evict. frameNumbers numbers the
+		// rows of features of a selection of the frames (see
+		// writeFeatureFile()).
+		void store(const string &key, FeatureType type, int frameWidth, int frameHeight, int blocksX, int blocksY, const Mat &features, const vector<int> &frameNumbers = vector<int>());
+
+		// Add a copy of a feature file as an entry, then evict
+		void storeFile(const string &key, string filename);
+
+		// Remove the least recently used entries until they fit the capacity
+		void evict();
+
+		// Where to keep a file derived from an entry, named after its key
+		// with the given extension ("_<parameter>" and .ivf or .pq, or it is
+		// never evicted), or an empty string if not caching. Its writer
+		// should call evict() once it has been written.
+		string companionPath(const string &key, string extension);
+
+	protected:
+		string entryPath(const string &key) const;
+		string temporaryPath(const string &key) const;
+		bool prepareDirectory();
+		void touch(const string &path);
+
+		string _directory;
+		size_t _capacity;
+		bool _enabled = true;
+};
+
+#endif
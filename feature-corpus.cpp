@@ -0,0 +1,246 @@
+#include "feature-corpus.hpp"
+
+#include <algorithm>
+#include <future>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "top-k.hpp"
+#include "log.hpp"
+
+static string removeExtension(string name) {
+	string::size_type index = name.rfind('.');
+
+	if (index != string::npos)
+		return name.substr(0, index);
+	else
+		return name;
+}
+
+int VideoFeatures::frameNumber(int row) const {
+	return frameNumbers.empty() ? row : frameNumbers[row];
+}
+
+int VideoFeatures::row(int frameNumber) const {
+	if (frameNumbers.empty())
+		return frameNumber >= 0 && frameNumber < features.rows ? frameNumber : -1;
+
+	// The frames are numbered in increasing order
+	vector<int>::const_iterator found = lower_bound(frameNumbers.begin(), frameNumbers.end(), frameNumber);
+
+	return found != frameNumbers.end() && *found == frameNumber ? (int)(found - frameNumbers.begin()) : -1;
+}
+
+bool VideoFeatures::isComparable(const VideoFeatures &other) const {
+	if (type != other.type || features.cols != other.features.cols)
+		return false;
+
+	return type == FEATURE_FRAME_DWT || (blocksX == other.blocksX && blocksY == other.blocksY);
+}
+
+bool loadVideoFeatures(string directory, string filename, int choice, int parameter, FeatureCache &cache, const ExtractionOptions &options, VideoFeatures &result) {
+	string videoname = removeExtension(filename);
+	VideoCapture capture(directory + "/" + filename);
+	ExtractionOptions extraction = options;
+	BlockProcessor *processor = NULL;
+
+	if (!capture.isOpened())
+		return false;
+
+	result = VideoFeatures();
+	result.path = directory + "/" + filename;
+	result.filename = filename;
+	result.frameWidth = capture.get(CV_CAP_PROP_FRAME_WIDTH);
+	result.frameHeight = capture.get(CV_CAP_PROP_FRAME_HEIGHT);
+	extraction.videoPath = result.path;
+
+	if (choice == 5) {
+		result.featurefilename = frameFeaturesFileName(videoname, parameter, options.frames);
+	}
+	else {
+		processor = createBlockProcessor(capture, videoname, choice, options);
+
+		if (processor == NULL)
+			return false;
+
+		processor->dontReadInput();
+		processor->setInput(parameter);
+		processor->initialize();
+
+		result.featurefilename = processor->getOutputFileName();
+		result.type = processor->getFeatureType();
+		result.blocksX = result.frameWidth/processor->getBlockSize();
+		result.blocksY = result.frameHeight/processor->getBlockSize();
+	}
+
+	result.key = cache.key(result.path, result.featurefilename, extractionDecoder(extraction));
+	result.mapped = make_shared<MappedFeatureFile>();
+
+	if (!cache.map(result.key, *result.mapped)) {
+		// Only cached if every selected frame was extracted, so a decoding
+		// error isn't served from the cache on every later run
+		if (processor != NULL) {
+			if (extractBlockFeatures(processor, capture, extraction, result.features, &result.frameNumbers) && result.features.rows > 0)
+				cache.store(result.key, result.type, result.frameWidth, result.frameHeight, result.blocksX, result.blocksY, result.features, result.frameNumbers);
+		}
+		else {
+			if (extractFrameFeatures(capture, videoname, parameter, extraction, result.features, &result.frameNumbers) && result.features.rows > 0)
+				cache.store(result.key, FEATURE_FRAME_DWT, result.frameWidth, result.frameHeight, 1, 1, result.features, result.frameNumbers);
+		}
+
+		// Use the cached copy if there is one, so every video's features
+		// are 16 bit and paged in from the same place
+		if (!cache.map(result.key, *result.mapped))
+			result.mapped.reset();
+	}
+
+	if (result.mapped) {
+		result.features = result.mapped->features();
+		result.frameNumbers = result.mapped->frameNumbers();
+	}
+
+	// Every frame in order needs no numbers
+	bool numbered = false;
+
+	for (size_t i = 0; i < result.frameNumbers.size() && !numbered; i++) {
+		numbered = result.frameNumbers[i] != (int)i;
+	}
+
+	if (!numbered)
+		result.frameNumbers.clear();
+
+	delete processor;
+	return true;
+}
+
+FeatureCorpus::FeatureCorpus(FeatureCache &cache, const ExtractionOptions &options) : _cache(cache) {
+	_options = options;
+}
+
+int FeatureCorpus::addDirectory(string directory, int choice, int parameter) {
+	DIR *listing = opendir(directory.c_str());
+	vector<string> filenames;
+	int added = 0;
+
+	if (listing == NULL) {
+		LOG(LOG_ERROR) << "[*] ERROR: Couldn't list the videos in " << directory;
+		return 0;
+	}
+
+	while (struct dirent *item = readdir(listing)) {
+		string name = item->d_name;
+		struct stat info;
+
+		if (name[0] == '.' || stat((directory + "/" + name).c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+			continue;
+
+		filenames.push_back(name);
+	}
+
+	closedir(listing);
+	sort(filenames.begin(), filenames.end());
+
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (addVideo(directory, filenames[i], choice, parameter))
+			added++;
+	}
+
+	return added;
+}
+
+bool FeatureCorpus::addVideo(string directory, string filename, int choice, int parameter) {
+	VideoFeatures video;
+
+	if (!loadVideoFeatures(directory, filename, choice, parameter, _cache, _options, video)) {
+		LOG(LOG_INFO) << "[*] Skipping " << directory << "/" << filename << ": not a video";
+		return false;
+	}
+
+	if (video.features.rows == 0) {
+		LOG(LOG_INFO) << "[*] Skipping " << directory << "/" << filename << ": no frames";
+		return false;
+	}
+
+	LOG(LOG_INFO) << "[*] Added " << video.path << ": " << video.features.rows << " frames";
+	_videos.push_back(video);
+
+	return true;
+}
+
+int FeatureCorpus::size() const {
+	return (int)_videos.size();
+}
+
+const VideoFeatures &FeatureCorpus::video(int index) const {
+	return _videos[index];
+}
+
+int FeatureCorpus::find(string filename) const {
+	for (size_t i = 0; i < _videos.size(); i++) {
+		if (_videos[i].filename == filename)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+vector<CorpusMatch> FeatureCorpus::search(int video, int frame, int nummatches, ThreadPool *pool) const {
+	if (video < 0 || video >= size() || frame < 0 || frame >= _videos[video].features.rows)
+		return vector<CorpusMatch>();
+
+	return search(_videos[video].features.row(frame), _videos[video], nummatches, video, frame, pool);
+}
+
+vector<CorpusMatch> FeatureCorpus::search(const Mat &query, const VideoFeatures &like, int nummatches, int excludeVideo, int excludeFrame, ThreadPool *pool) const {
+	// Copied, so that the workers don't depend on the caller's matrix
+	Mat row = query.clone();
+	vector<future<vector<frame_match>>> results;
+	vector<int> searched;
+
+	for (int v = 0; v < size(); v++) {
+		const Mat &features = _videos[v].features;
+		int exclude = v == excludeVideo ? excludeFrame : -1;
+
+		// Rows of other shapes would be compared column by column with
+		// components of other blocks, or of other features
+		if (!_videos[v].isComparable(like) || features.cols != row.cols || features.rows == 0)
+			continue;
+
+		searched.push_back(v);
+
+		if (pool == NULL) {
+			promise<vector<frame_match>> result;
+			result.set_value(findMatchingFrames(features, row, nummatches, exclude));
+			results.push_back(result.get_future());
+		}
+		else {
+			results.push_back(pool->submit([&features, &row, nummatches, exclude]() {
+				return findMatchingFrames(features, row, nummatches, exclude);
+			}));
+		}
+	}
+
+	// Keyed by (video, frame), so equal scores are ordered by video and then
+	// by frame
+	TopK<double, pair<int, int>> best(max(nummatches, 0));
+
+	for (size_t i = 0; i < results.size(); i++) {
+		vector<frame_match> matches = results[i].get();
+
+		for (size_t j = 0; j < matches.size(); j++) {
+			best.push(make_pair(searched[i], matches[j].first), matches[j].second);
+		}
+	}
+
+	vector<TopK<double, pair<int, int>>::Entry> ranked = best.sorted();
+	vector<CorpusMatch> matches(ranked.size());
+
+	for (size_t i = 0; i < ranked.size(); i++) {
+		matches[i].video = ranked[i].first.first;
+		matches[i].frame = ranked[i].first.second;
+		matches[i].score = ranked[i].second;
+	}
+
+	return matches;
+}
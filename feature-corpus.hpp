@@ -0,0 +1,129 @@
+#ifndef FEATURE_CORPUS_HPP
+#define FEATURE_CORPUS_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+#include "feature-extraction.hpp"
+#include "feature-cache.hpp"
+#include "feature-file.hpp"
+#include "frame-matching.hpp"
+#include "thread-pool.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * The features of many videos, for matching frames across all of them.
+ *
+ * Each video of a corpus is a shard: its features, computed once and kept in
+ * the feature cache (see feature-cache.hpp) like those of a single video,
+ * and mapped from there. A match is keyed by the video's number in the
+ * corpus and the frame's number in the video.
+ *
+ * A search scans the shards on the workers of a thread pool, a shard per
+ * task, and merges their best matches. Only shards whose features are
+ * comparable with the query's are searched: the same feature type, with as
+ * many components, and for block features the same grid of blocks, since a
+ * column of a block feature row belongs to one block of the frame. Frame DWT
+ * features compare between videos of any frame size.
+ *
+ * Matches are keyed by row. When the features are of a selection of the
+ * frames, VideoFeatures::frameNumber() tells which frame a row is.
+ *
+ * Usage:
+ *
+ *   FeatureCorpus corpus(cache, options);
+ *   corpus.addDirectory("videos", choice, n);
+ *
+ *   vector<CorpusMatch> matches = corpus.search(corpus.find("1.mp4"), frameid, 10, &pool);
+ */
+
+// The features of one video, and where they came from
+struct VideoFeatures {
+	string path;
+	string filename;
+
+	// The name of the task1/task2 output file for them, and their key in
+	// the cache (empty if not caching)
+	string featurefilename;
+	string key;
+
+	int frameWidth = 0;
+	int frameHeight = 0;
+
+	// The feature type, and the blocks per row and column of a frame (1x1
+	// for the frame DWT)
+	FeatureType type = FEATURE_FRAME_DWT;
+	int blocksX = 1;
+	int blocksY = 1;
+
+	// One row per frame. If the features are mapped from the cache, the
+	// mapping is kept open by mapped, so copies of this stay valid.
+	Mat features;
+	shared_ptr<MappedFeatureFile> mapped;
+
+	// The frame number of each row, when the features are of a selection of
+	// the frames (see FrameSelection); empty if row i is frame i
+	vector<int> frameNumbers;
+
+	int frameNumber(int row) const;
+
+	// The row of a frame, or -1 if it has none
+	int row(int frameNumber) const;
+
+	// Whether a row of these features can be compared with a row of other's
+	// at all: the same type and row size, and for block features the same
+	// block grid
+	bool isComparable(const VideoFeatures &other) const;
+};
+
+// The features of Task 1 sub-task choice (1 to 4) or, for choice 5, the
+// Task 2 frame DWT of the selected frames of a video (options.frames), with
+// parameter as n (or m). They are read
+// from the cache if they are in it, or extracted and then cached. Returns
+// false if the video can't be opened or the choice is unknown.
+bool loadVideoFeatures(string directory, string filename, int choice, int parameter, FeatureCache &cache, const ExtractionOptions &options, VideoFeatures &result);
+
+// A frame of the corpus, and its distance to the query
+struct CorpusMatch {
+	int video;
+	int frame;
+	double score;
+};
+
+class FeatureCorpus {
+
+	public:
+		FeatureCorpus(FeatureCache &cache, const ExtractionOptions &options);
+
+		// Add every video in the directory, in file name order. Files that
+		// can't be opened as videos, or have no frames, are skipped. Returns
+		// the number added.
+		int addDirectory(string directory, int choice, int parameter);
+		bool addVideo(string directory, string filename, int choice, int parameter);
+
+		int size() const;
+		const VideoFeatures &video(int index) const;
+
+		// The number of the video with this file name, or -1
+		int find(string filename) const;
+
+		// The nummatches frames of the corpus closest to a frame of one of
+		// its videos, not including that frame; closest first
+		vector<CorpusMatch> search(int video, int frame, int nummatches, ThreadPool *pool = NULL) const;
+
+		// The same for any row of features like those of video like,
+		// excluding one frame (if any). Only the videos comparable with like
+		// are searched.
+		vector<CorpusMatch> search(const Mat &query, const VideoFeatures &like, int nummatches, int excludeVideo = -1, int excludeFrame = -1, ThreadPool *pool = NULL) const;
+
+	protected:
+		FeatureCache &_cache;
+		ExtractionOptions _options;
+		vector<VideoFeatures> _videos;
+};
+
+#endif
@@ -0,0 +1,383 @@
+#include "feature-extraction.hpp"
+
+#include <sstream>
+#include <thread>
+
+#include "task1-dctprocessor.hpp"
+#include "task1-dwtprocessor.hpp"
+#include "task1-histogramprocessor.hpp"
+#include "dwt-haar.hpp"
+#include "zigzag.hpp"
+#include "feature-file.hpp"
+#include "buffered-writer.hpp"
+#include "frame-pipeline.hpp"
+#include "luma-decoder.hpp"
+#include "bounded-queue.hpp"
+#include "log.hpp"
+
+bool canSelectFrames(const ExtractionOptions &options) {
+	if (!options.frames.isValid())
+		return false;
+
+	if (!options.frames.keyframesOnly)
+		return true;
+
+	LumaDecoder decoder;
+	return options.directDecode && decoder.open(options.videoPath);
+}
+
+string extractionDecoder(const ExtractionOptions &options) {
+	LumaDecoder decoder;
+
+	if (options.directDecode && !options.videoPath.empty() && decoder.open(options.videoPath))
+		return "luma";
+
+	return string();
+}
+
+BlockProcessor *createBlockProcessor(VideoCapture &capture, string videoname, int choice, const ExtractionOptions &options) {
+	BlockProcessor *processor = NULL;
+
+	switch (choice) {
+		case 1:
+			processor = new HistogramProcessor(capture, videoname, /* isDifferenceProcessor = */ false);
+			break;
+
+		case 2:
+			processor = new DCTProcessor(capture, videoname);
+			((DCTProcessor *)processor)->setKernel(options.dctKernel);
+			break;
+
+		case 3:
+			processor = new DWTProcessor(capture, videoname);
+			break;
+
+		case 4:
+			processor = new HistogramProcessor(capture, videoname, /* isDifferenceProcessor = */ true);
+			break;
+	}
+
+	if (processor != NULL && !processor->supportsBlockSize(options.blockSize)) {
+		LOG(LOG_ERROR) << "[*] ERROR: Unsupported block size " << options.blockSize << " for feature type " << choice << ".";
+		delete processor;
+		return NULL;
+	}
+
+	if (processor != NULL) {
+		processor->setBlockSize(options.blockSize);
+		processor->setFrameSelection(options.frames);
+		processor->exportCSV(options.exportCSV);
+
+		if (!options.writeOutputFile)
+			processor->dontWriteOutputFile();
+
+		if (options.keepFeatures)
+			processor->keepFeatures();
+	}
+
+	return processor;
+}
+
+// Have the pipeline decode the Y components directly, if asked to and able
+static void decodeDirectly(FramePipeline &pipeline, const ExtractionOptions &options) {
+	if (!options.directDecode || options.videoPath.empty())
+		return;
+
+	if (pipeline.decodeDirectly(options.videoPath))
+		LOG(LOG_DEBUG) << "[*] Decoding the Y components of " << options.videoPath << " directly";
+}
+
+// Whether the selection can be extracted by the pipeline: keyframes need the
+// decoder to pick them out
+static bool selectFrames(FramePipeline &pipeline, const ExtractionOptions &options) {
+	if (!options.frames.keyframesOnly || pipeline.selectKeyframes())
+		return true;
+
+	LOG(LOG_ERROR) << "[*] ERROR: Keyframes can only be picked out when decoding the Y components directly (see luma-decoder.hpp). Stopping.";
+	return false;
+}
+
+// Whether every frame of the selection was extracted; reports the first one
+// that wasn't
+static bool checkExtracted(const FrameSelection &frames, int frameCount, int extracted) {
+	int expected = frames.count(frameCount);
+
+	if (expected < 0 || extracted >= expected)
+		return true;
+
+	LOG(LOG_ERROR) << "[*] ERROR: Couldn't extract frame " << frames.start + extracted * frames.stride << ". Stopping.";
+	return false;
+}
+
+bool extractBlockFeatures(BlockProcessor *processor, VideoCapture &capture, const ExtractionOptions &options, Mat &features, vector<int> *frameNumbers) {
+	int fcount = capture.get(CV_CAP_PROP_FRAME_COUNT);
+	int writeQueueSize = options.writeQueueSize > 0 ? options.writeQueueSize : 4;
+	bool isDifference = processor->getFeatureType() == FEATURE_BLOCK_DIFFERENCE_HISTOGRAM;
+
+	Mat ychan, previous, input;
+	int frameIndex, previousIndex = -1;
+	int extracted = 0;
+
+	// Pipeline: the decoder and colour conversion stages run on their own
+	// threads, the rows of blocks of each frame are transformed on the pool's
+	// workers, and a single writer appends the results in frame order.
+	ThreadPool pool(options.threads);
+	FramePipeline pipeline(capture, options.decodeQueueSize, options.convertQueueSize);
+	decodeDirectly(pipeline, options);
+
+	features = Mat();
+
+	if (!selectFrames(pipeline, options)) {
+		processor->finish();
+		return false;
+	}
+
+	BoundedQueue<BlockProcessor::PendingFrame> pending(writeQueueSize);
+
+	thread writer([&]() {
+		BlockProcessor::PendingFrame frame;
+
+		while (pending.pop(frame)) {
+			processor->writeFrame(frame);
+			LOG(LOG_INFO) << "[*] Processed frame " << frame.frameIndex;
+		}
+	});
+
+	pipeline.start(options.frames, fcount);
+
+	// Extract and process each selected frame
+	while (pipeline.next(frameIndex, ychan)) {
+		extracted++;
+		input = ychan;
+
+		// For the difference processor, a frame is processed once the next
+		// selected frame has been decoded, and keeps the number of the first
+		// of the two.
+		if (isDifference) {
+			Mat current, diff;
+
+			if (previous.empty()) {
+				previous = ychan;
+				previousIndex = frameIndex;
+				continue;
+			}
+
+			// Set the frame to the difference between the two. The frames
+			// are still in flight, so use new buffers for every frame.
+			previous.convertTo(previous, CV_32S);
+			ychan.convertTo(current, CV_32S);
+			diff = previous - current;
+
+			input = diff;
+			previous = current;
+			swap(frameIndex, previousIndex);
+		}
+
+		// Hand the blocks of the frame to the workers
+		pending.push(processor->submitFrame(input, frameIndex, pool));
+	}
+
+	bool complete = checkExtracted(options.frames, fcount, extracted);
+
+	pending.close();
+	writer.join();
+
+	if (!processor->finish()) {
+		LOG(LOG_ERROR) << "[*] ERROR: Couldn't write " << processor->getOutputFileName() << ". Stopping.";
+		complete = false;
+	}
+
+	if (frameNumbers != NULL)
+		*frameNumbers = processor->getFrameNumbers();
+
+	features = processor->getFeatures();
+	return complete;
+}
+
+// The output of the frame DWT for one frame: its row of features, its lines
+// in the CSV export (if any) and its frame in the debugging video (if any)
+struct FrameDWT {
+	vector<short> components;
+	string csv;
+	Mat visual;
+};
+
+// The size of the corner of the transformed frame whose zigzag scan gives
+// the frame DWT's components: 8x8 for up to 64 components, as it always has
+// been, and 16x16 or 32x32 for more, as far as the frame allows
+static int frameZigzagSize(int numComponents, int width, int height) {
+	int size = 8;
+
+	while (size < 32 && size * size < numComponents)
+		size *= 2;
+
+	while (size > 4 && (size > width || size > height))
+		size /= 2;
+
+	return size;
+}
+
+static FrameDWT processFrameDWT(Mat data, int frameIndex, int width, int height, int numComponents, const ExtractionOptions &options) {
+	FrameDWT result;
+	ostringstream csv;
+
+	// Convert the data to 32 bit float version
+	data.convertTo(data, CV_32F);
+
+	int dwtwidth = width, dwtheight = height;
+	vector<float> scratch(haarScratchSize(width, height));
+
+	// Stop when our corner to operate on is less than 2 in any dimension
+	while (dwtwidth >= 2 && dwtheight >= 2) {
+		// Apply the DWT on the current top-left corner (width and height) of the frame
+		haarForward2D(data, dwtwidth, dwtheight, scratch);
+
+		// Halve the corner size that we will operate on
+		dwtwidth /= 2;
+		dwtheight /= 2;
+	}
+
+	// Obtain the m most significant components, from the top-left corner of
+	// the transformed frame
+	int size = frameZigzagSize(numComponents, width, height);
+
+	result.components.assign(min(numComponents, size * size), 0);
+	zigzagGather(data.ptr<float>(0), data.step1(), size, (int)result.components.size(), result.components.data());
+
+	if (options.exportCSV) {
+		for (size_t k = 0; k < result.components.size(); k++) {
+			csv << frameIndex << ',' << k << ',' << result.components[k] << '\n';
+		}
+	}
+
+	// Convert the data back to unsigned bytes
+	if (options.writeVisualization) {
+		data.convertTo(data, CV_8U);
+		cvtColor(data, result.visual, CV_GRAY2BGR);
+	}
+
+	result.csv = csv.str();
+	return result;
+}
+
+string frameFeaturesFileName(string videoname, int numComponents, const FrameSelection &frames) {
+	return videoname + "_framedwt_" + to_string(numComponents) + frames.suffix() + ".fwt";
+}
+
+bool extractFrameFeatures(VideoCapture &capture, string videoname, int numComponents, const ExtractionOptions &options, Mat &features, vector<int> *frameNumbers) {
+	int fcount = capture.get(CV_CAP_PROP_FRAME_COUNT);
+	int width = capture.get(CV_CAP_PROP_FRAME_WIDTH);
+	int height = capture.get(CV_CAP_PROP_FRAME_HEIGHT);
+	int zigzagSize = frameZigzagSize(numComponents, width, height);
+	int components = min(numComponents, zigzagSize * zigzagSize);
+
+	// Each frame is transformed by a single worker, so keep enough frames in
+	// flight to occupy all of them
+	int writeQueueSize = options.writeQueueSize > 0 ? options.writeQueueSize : 2 * max(options.threads, 1);
+
+	string outfilename = frameFeaturesFileName(videoname, numComponents, options.frames);
+	FeatureWriter outfile;
+	BufferedWriter csvfile;
+	VideoWriter writer;
+	vector<short> kept;
+	vector<int> keptFrames;
+
+	features = Mat();
+
+	if (options.writeOutputFile) {
+		bool opened = outfile.open(outfilename, FEATURE_FRAME_DWT, width, height, 1, 1, components);
+
+		if (opened && options.exportCSV)
+			opened = csvfile.open(outfilename + ".csv");
+
+		if (!opened) {
+			LOG(LOG_ERROR) << "[*] ERROR: Couldn't create " << outfilename << ". Stopping.";
+			return false;
+		}
+	}
+
+	// Create the video file (debugging!)
+	if (options.writeVisualization) {
+		string outvideoname = outfilename + ".mov";
+		int codec = CV_FOURCC('m', 'p', '4', 'v');
+		writer.open(outvideoname, codec, 24.0, Size(width,height), true);
+
+		if (!writer.isOpened()) {
+			LOG(LOG_ERROR) << "[*] FATAL: Couldn't open file to write video";
+			return false;
+		}
+	}
+
+	// Pipeline: the decoder and colour conversion stages run on their own
+	// threads, each frame is transformed on one of the pool's workers, and a
+	// single writer writes the results in frame order.
+	ThreadPool pool(options.threads);
+	FramePipeline pipeline(capture, options.decodeQueueSize, options.convertQueueSize);
+	decodeDirectly(pipeline, options);
+
+	if (!selectFrames(pipeline, options))
+		return false;
+
+	BoundedQueue<pair<int, future<FrameDWT>>> pending(writeQueueSize);
+
+	thread output([&]() {
+		pair<int, future<FrameDWT>> frame;
+
+		while (pending.pop(frame)) {
+			FrameDWT result = frame.second.get();
+
+			if (options.keepFeatures) {
+				kept.insert(kept.end(), result.components.begin(), result.components.end());
+				keptFrames.push_back(frame.first);
+			}
+
+			if (options.writeOutputFile) {
+				outfile.writeFrame(result.components.data(), frame.first);
+				outfile.flush();
+				csvfile.write(result.csv);
+				csvfile.flush();
+			}
+
+			if (options.writeVisualization)
+				writer.write(result.visual);
+
+			LOG(LOG_INFO) << "[*] Processed frame " << frame.first;
+		}
+	});
+
+	pipeline.start(options.frames, fcount);
+
+	int frameIndex;
+	int extracted = 0;
+	Mat ychan;
+
+	// Extract and process each selected frame
+	while (pipeline.next(frameIndex, ychan)) {
+		extracted++;
+
+		// Process the ychan component
+		pending.push(make_pair(frameIndex, pool.submit([=, &options]() {
+			return processFrameDWT(ychan, frameIndex, width, height, numComponents, options);
+		})));
+	}
+
+	bool complete = checkExtracted(options.frames, fcount, extracted);
+
+	pending.close();
+	output.join();
+
+	bool written = outfile.close();
+	written = csvfile.close() && written;
+
+	if (!written) {
+		LOG(LOG_ERROR) << "[*] ERROR: Couldn't write " << outfilename << ". Stopping.";
+		complete = false;
+	}
+
+	if (frameNumbers != NULL)
+		*frameNumbers = keptFrames;
+
+	Mat((int)(kept.size() / max(components, 1)), components, CV_16S, kept.data()).convertTo(features, CV_32S);
+
+	return complete;
+}
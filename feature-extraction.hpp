@@ -0,0 +1,110 @@
+#ifndef FEATURE_EXTRACTION_HPP
+#define FEATURE_EXTRACTION_HPP
+
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include "task1-blockprocessor.hpp"
+#include "frame-source.hpp"
+#include "block-dct.hpp"
+#include "thread-pool.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * The feature extraction of Task 1 (block features) and Task 2 (frame DWT)
+ * as a library, so that Task 3 can compute the features of a video in
+ * process instead of running the task1 and task2 programs and reading their
+ * output files back.
+ *
+ * Both extractions decode the video through a FramePipeline and transform
+ * the frames on a thread pool: every frame, or the selection of them in
+ * ExtractionOptions::frames. They return the features as a (frames x
+ * components) CV_32S matrix, laid out like the rows of a feature file (see
+ * feature-file.hpp), and write the feature file, each unless asked not to.
+ * The frame number of each row can be returned alongside.
+ *
+ * Both return false if the extraction stopped short: the selection couldn't
+ * be picked out, a selected frame couldn't be decoded, or the output files
+ * couldn't be written in full (a full disk, an I/O error). The features of
+ * the frames before are still returned and written, but are incomplete and
+ * must not be cached.
+ *
+ * Usage (Task 1):
+ *
+ *   BlockProcessor *processor = createBlockProcessor(capture, videoname, choice, options);
+ *   processor->setInput(n);    // or let initialize() prompt for it
+ *   processor->dontReadInput();
+ *   processor->initialize();
+ *   Mat features;
+ *   bool complete = extractBlockFeatures(processor, capture, options, features);
+ */
+
+struct ExtractionOptions {
+	int threads = ThreadPool::defaultSize();
+	int decodeQueueSize = 8;
+	int convertQueueSize = 8;
+
+	// Frames in flight between the transform and write stages; 0 picks a
+	// default suited to the extraction
+	int writeQueueSize = 0;
+
+	DCTKernel dctKernel = DCT_KERNEL_FLOAT;
+
+	// The file the capture was opened from. If set, and with directDecode,
+	// the Y components of its frames are decoded directly where the build
+	// and the video allow it (see luma-decoder.hpp). Off by default until the
+	// decoder has been checked against real videos.
+	string videoPath;
+	bool directDecode = false;
+
+	// The frames to extract features from. The difference histogram of a
+	// selection is between each selected frame and the next one selected.
+	FrameSelection frames;
+
+	// The width and height of the Task 1 blocks: 4, 8, 16 or 32 (see
+	// block-transform.hpp)
+	int blockSize = 8;
+
+	// Write the feature file (and its CSV export) as task1 and task2 do
+	bool writeOutputFile = true;
+	bool exportCSV = false;
+
+	// Return the features; otherwise an empty matrix is returned, which
+	// saves keeping every frame's features in memory
+	bool keepFeatures = true;
+
+	// Task 2 only: also write the transformed frames to a video, for
+	// debugging
+	bool writeVisualization = false;
+};
+
+// Whether options.frames is a valid selection that can be picked out of the
+// video at options.videoPath: keyframes need direct decoding
+bool canSelectFrames(const ExtractionOptions &options);
+
+// The decoder the frames of options.videoPath will be read with, for the
+// feature cache key: "luma" when decoding directly, or an empty string for
+// the capture
+string extractionDecoder(const ExtractionOptions &options);
+
+// Create the Task 1 processor for sub-task choice (1 to 4, as numbered in
+// the menus of task1 and task3). Returns NULL for an unknown choice, or a
+// block size the processor doesn't support.
+BlockProcessor *createBlockProcessor(VideoCapture &capture, string videoname, int choice, const ExtractionOptions &options);
+
+// Run an initialized Task 1 processor over the selected frames of the
+// video, and store the frame number of each row in frameNumbers (if given).
+// Returns false if the extraction stopped short.
+bool extractBlockFeatures(BlockProcessor *processor, VideoCapture &capture, const ExtractionOptions &options, Mat &features, vector<int> *frameNumbers = NULL);
+
+// The name of the Task 2 output file for the video
+string frameFeaturesFileName(string videoname, int numComponents, const FrameSelection &frames);
+
+// Compute the Task 2 frame DWT features of the selected frames of the video.
+// Returns false if the extraction stopped short.
+bool extractFrameFeatures(VideoCapture &capture, string videoname, int numComponents, const ExtractionOptions &options, Mat &features, vector<int> *frameNumbers = NULL);
+
+#endif
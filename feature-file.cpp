@@ -0,0 +1,276 @@
+#include "feature-file.hpp"
+
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char featureMagic[4] = {'F', 'E', 'A', 'T'};
+static const int featureVersion = 2;
+
+FeatureWriter::FeatureWriter() {
+	memset(&_header, 0, sizeof(_header));
+}
+
+FeatureWriter::~FeatureWriter() {
+	close();
+}
+
+bool FeatureWriter::open(string filename, FeatureType type, int frameWidth, int frameHeight, int blocksX, int blocksY, int components) {
+	memcpy(_header.magic, featureMagic, sizeof(featureMagic));
+	_header.version = featureVersion;
+	_header.type = type;
+	_header.frameWidth = frameWidth;
+	_header.frameHeight = frameHeight;
+	_header.blocksX = blocksX;
+	_header.blocksY = blocksY;
+	_header.components = components;
+	_header.valueSize = sizeof(short);
+	_header.frameCount = 0;
+	_header.sampled = 0;
+	_frameNumbers.clear();
+
+	if (!_file.open(filename))
+		return false;
+
+	// The frame count is filled in by close()
+	_file.write(&_header, sizeof(_header));
+
+	return true;
+}
+
+void FeatureWriter::writeFrame(const short *row, int frameNumber) {
+	if (frameNumber < 0)
+		frameNumber = _frameNumbers.empty() ? 0 : _frameNumbers.back() + 1;
+
+	if (frameNumber != _header.frameCount)
+		_header.sampled = 1;
+
+	_file.write(row, (size_t)_header.rowSize() * sizeof(short));
+	_frameNumbers.push_back(frameNumber);
+	_header.frameCount++;
+}
+
+bool FeatureWriter::flush() {
+	return _file.flush();
+}
+
+bool FeatureWriter::close() {
+	if (!_file.isOpen())
+		return _file.close();
+
+	// The frame numbers follow the rows, if they aren't just the row numbers
+	if (_header.sampled)
+		_file.write(_frameNumbers.data(), _frameNumbers.size() * sizeof(int32_t));
+
+	_file.writeAt(0, &_header, sizeof(_header));
+	return _file.close();
+}
+
+const FeatureHeader &FeatureWriter::header() const {
+	return _header;
+}
+
+// Whether a header read from a file of fileSize bytes describes rows that
+// fit in it. Every size is checked in 64 bits before it is multiplied, so a
+// corrupt header can't overflow its way past the check.
+static bool isConsistent(const FeatureHeader &header, uint64_t fileSize) {
+	if (memcmp(header.magic, featureMagic, sizeof(featureMagic)) != 0 || header.version != featureVersion)
+		return false;
+
+	if (header.valueSize != sizeof(short) && header.valueSize != sizeof(int32_t))
+		return false;
+
+	if (header.blocksX < 0 || header.blocksY < 0 || header.components < 0 || header.frameCount < 0 || fileSize < sizeof(header))
+		return false;
+
+	// rowSize() is an int, and so are the columns of the Mat of the rows
+	uint64_t rowSize = (uint64_t)header.blocksX * header.blocksY;
+
+	if (header.blocksY != 0 && rowSize / header.blocksY != (uint64_t)header.blocksX)
+		return false;
+
+	if (header.components != 0 && rowSize > (uint64_t)INT_MAX / header.components)
+		return false;
+
+	rowSize *= header.components;
+
+	// At most 2^31 - 1 values of 4 bytes, plus a frame number: no overflow
+	uint64_t rowBytes = rowSize * header.valueSize + (header.sampled ? sizeof(int32_t) : 0);
+
+	return header.frameCount == 0 || rowBytes <= (fileSize - sizeof(header)) / header.frameCount;
+}
+
+// Read the frame numbers that follow the rows of a sampled file
+static bool readFrameNumbers(ifstream &file, const FeatureHeader &header, vector<int> *frameNumbers) {
+	if (frameNumbers == NULL)
+		return true;
+
+	frameNumbers->clear();
+
+	if (!header.sampled)
+		return true;
+
+	frameNumbers->resize(header.frameCount);
+
+	return header.frameCount == 0 || (bool)file.read((char *)frameNumbers->data(), (streamsize)header.frameCount * sizeof(int32_t));
+}
+
+bool readFeatureFile(string filename, FeatureHeader &header, Mat &features, vector<int> *frameNumbers) {
+	ifstream file(filename, ios::in | ios::binary);
+
+	if (!file.is_open())
+		return false;
+
+	if (!file.read((char *)&header, sizeof(header)))
+		return false;
+
+	// Checked against the file's size before anything is allocated
+	file.seekg(0, ios::end);
+	uint64_t fileSize = (uint64_t)file.tellg();
+	file.seekg(sizeof(header));
+
+	if (!file || !isConsistent(header, fileSize))
+		return false;
+
+	int rowSize = header.rowSize();
+	features.create(header.frameCount, rowSize, CV_32S);
+
+	if (header.valueSize == sizeof(int32_t)) {
+		for (int i = 0; i < header.frameCount; i++) {
+			if (!file.read((char *)features.ptr<int>(i), (streamsize)rowSize * sizeof(int32_t)))
+				return false;
+		}
+
+		return readFrameNumbers(file, header, frameNumbers);
+	}
+
+	// Widen the 16 bit values one row at a time
+	vector<short> row(rowSize);
+
+	for (int i = 0; i < header.frameCount; i++) {
+		if (!file.read((char *)row.data(), (streamsize)rowSize * sizeof(short)))
+			return false;
+
+		int *values = features.ptr<int>(i);
+
+		for (int j = 0; j < rowSize; j++) {
+			values[j] = row[j];
+		}
+	}
+
+	return readFrameNumbers(file, header, frameNumbers);
+}
+
+MappedFeatureFile::MappedFeatureFile() {
+	memset(&_header, 0, sizeof(_header));
+}
+
+MappedFeatureFile::~MappedFeatureFile() {
+	close();
+}
+
+bool MappedFeatureFile::open(string filename) {
+	close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	struct stat info;
+
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(_header)) {
+		::close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	_data = data;
+	_size = info.st_size;
+	memcpy(&_header, _data, sizeof(_header));
+
+	if (!isConsistent(_header, _size)) {
+		close();
+		return false;
+	}
+
+	// The matching scans the rows in order
+	madvise(_data, _size, MADV_SEQUENTIAL);
+
+	return true;
+}
+
+void MappedFeatureFile::close() {
+	if (_data != NULL)
+		munmap(_data, _size);
+
+	_data = NULL;
+	_size = 0;
+	memset(&_header, 0, sizeof(_header));
+}
+
+bool MappedFeatureFile::isOpen() const {
+	return _data != NULL;
+}
+
+const FeatureHeader &MappedFeatureFile::header() const {
+	return _header;
+}
+
+Mat MappedFeatureFile::features() const {
+	if (_data == NULL)
+		return Mat();
+
+	int type = _header.valueSize == sizeof(short) ? CV_16S : CV_32S;
+	char *values = (char *)_data + sizeof(_header);
+
+	return Mat(_header.frameCount, _header.rowSize(), type, values);
+}
+
+vector<int> MappedFeatureFile::frameNumbers() const {
+	vector<int> numbers;
+
+	if (_data == NULL || !_header.sampled)
+		return numbers;
+
+	// After the rows, and only aligned to the size of a value
+	const char *table = (const char *)_data + sizeof(_header) + (size_t)_header.frameCount * _header.rowSize() * _header.valueSize;
+
+	numbers.resize(_header.frameCount);
+	memcpy(numbers.data(), table, numbers.size() * sizeof(int32_t));
+
+	return numbers;
+}
+
+bool writeFeatureFile(string filename, FeatureType type, int frameWidth, int frameHeight, int blocksX, int blocksY, const Mat &features, const vector<int> &frameNumbers) {
+	CV_Assert(features.depth() == CV_32S);
+
+	FeatureWriter writer;
+	int components = features.cols / max(blocksX * blocksY, 1);
+
+	if (!writer.open(filename, type, frameWidth, frameHeight, blocksX, blocksY, components))
+		return false;
+
+	vector<short> row(features.cols);
+
+	for (int i = 0; i < features.rows; i++) {
+		const int *values = features.ptr<int>(i);
+
+		for (int j = 0; j < features.cols; j++) {
+			row[j] = saturate_cast<short>(values[j]);
+		}
+
+		writer.writeFrame(row.data(), frameNumbers.empty() ? i : frameNumbers[i]);
+	}
+
+	return writer.close();
+}
@@ -0,0 +1,137 @@
+#ifndef FEATURE_FILE_HPP
+#define FEATURE_FILE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+#include "buffered-writer.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * Binary feature files written by Task 1 and Task 2 and read by Task 3.
+ *
+ * The file starts with a FeatureHeader, followed by one row of values per
+ * frame, in frame order. A row holds the components of every block of the
+ * frame, block by block in raster order:
+ *
+ *      row[(blockY * blocksX + blockX) * components + component]
+ *
+ * Frame features (Task 2) use a 1x1 grid of blocks. components in the header
+ * is the number of components actually stored per block, which can be fewer
+ * than were asked for: a block has only N*N DCT or DWT coefficients, and a
+ * frame DWT only as many as its zigzag corner, so a request for more keeps
+ * them all and no more.
+ *
+ * The values are 16 bit signed integers, which holds every feature computed
+ * so far; valueSize in the header leaves room for 32 bit values. Everything
+ * is stored in the byte order of the machine that wrote the file.
+ *
+ * The rows of a file are usually frames 0, 1, 2 and so on. Features of a
+ * selection of the frames (see FrameSelection) have sampled set in the
+ * header, and the rows are followed by the frame number of each row, as 32
+ * bit integers.
+ */
+
+enum FeatureType {
+	FEATURE_BLOCK_HISTOGRAM = 1,
+	FEATURE_BLOCK_DCT = 2,
+	FEATURE_BLOCK_DWT = 3,
+	FEATURE_BLOCK_DIFFERENCE_HISTOGRAM = 4,
+	FEATURE_FRAME_DWT = 5
+};
+
+struct FeatureHeader {
+	char magic[4];
+	int32_t version;
+	int32_t type;
+	int32_t frameWidth;
+	int32_t frameHeight;
+	int32_t blocksX;
+	int32_t blocksY;
+	int32_t components;
+	int32_t valueSize;
+	int32_t frameCount;
+	int32_t sampled;
+
+	// The number of values in the row of each frame
+	int rowSize() const {
+		return blocksX * blocksY * components;
+	}
+};
+
+class FeatureWriter {
+
+	public:
+		FeatureWriter();
+		~FeatureWriter();
+
+		bool open(string filename, FeatureType type, int frameWidth, int frameHeight, int blocksX, int blocksY, int components);
+		// Rows written without a frame number are numbered after the row
+		// before them
+		void writeFrame(const short *row, int frameNumber = -1);
+
+		// Return false if any of the file fell short of the disk (see
+		// BufferedWriter)
+		bool flush();
+		bool close();
+
+		const FeatureHeader &header() const;
+
+	protected:
+		BufferedWriter _file;
+		FeatureHeader _header;
+		vector<int32_t> _frameNumbers;
+};
+
+// Read every frame of a feature file into a (frameCount x rowSize) CV_32S
+// matrix, and the frame number of each row if asked for (empty unless the
+// file is sampled). Returns false if the file can't be opened or isn't a
+// feature file.
+bool readFeatureFile(string filename, FeatureHeader &header, Mat &features, vector<int> *frameNumbers = NULL);
+
+// A read-only memory mapping of a feature file, whose values are used in
+// place: nothing is parsed or copied, pages are read in as the rows are
+// first touched, and processes mapping the same file share its pages.
+class MappedFeatureFile {
+
+	public:
+		MappedFeatureFile();
+		~MappedFeatureFile();
+
+		MappedFeatureFile(const MappedFeatureFile &) = delete;
+		MappedFeatureFile &operator=(const MappedFeatureFile &) = delete;
+
+		// Returns false if the file can't be mapped, isn't a feature file or
+		// is shorter than its header says
+		bool open(string filename);
+		void close();
+		bool isOpen() const;
+
+		const FeatureHeader &header() const;
+
+		// A (frameCount x rowSize) view of the values, CV_16S or CV_32S after
+		// the header's valueSize. It is only valid until the file is closed,
+		// so it must not outlive this object.
+		Mat features() const;
+
+		// The frame number of each row, or nothing if the rows are every
+		// frame in order
+		vector<int> frameNumbers() const;
+
+	protected:
+		void *_data = NULL;
+		size_t _size = 0;
+		FeatureHeader _header;
+};
+
+// Write a (frames x rowSize) CV_32S matrix as a feature file, with the frame
+// number of each row if they aren't every frame in order. Returns false if
+// the file couldn't be written in full.
+bool writeFeatureFile(string filename, FeatureType type, int frameWidth, int frameHeight, int blocksX, int blocksY, const Mat &features, const vector<int> &frameNumbers = vector<int>());
+
+#endif
@@ -0,0 +1,349 @@
+#include "frame-index.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <unistd.h>
+
+#include "top-k.hpp"
+#include "buffered-writer.hpp"
+
+static const char indexMagic[4] = {'F', 'I', 'D', 'X'};
+static const int indexVersion = 1;
+
+// The k-means training sample: this many rows per list, as long as the
+// sample fits in trainingBudget bytes
+static const int trainingRowsPerList = 32;
+static const size_t trainingBudget = (size_t)256 << 20;
+
+// Fixed, so that building an index of the same features gives the same index
+static const uint64_t trainingSeed = 0x5eed5eed;
+
+struct IndexHeader {
+	char magic[4];
+	int32_t version;
+	int32_t rows;
+	int32_t dimensions;
+	int32_t lists;
+};
+
+// The labels of rows [begin, end): the nearest centroid of each
+static vector<int> assignRows(const Mat &features, const Mat &centroids, int begin, int end) {
+	vector<int> labels(end - begin);
+	vector<float> row(features.cols);
+
+	for (int i = begin; i < end; i++) {
+		double best = numeric_limits<double>::infinity();
+		featureRowToFloat(features, i, row.data());
+
+		for (int k = 0; k < centroids.rows; k++) {
+			double distance = squaredDistance(row.data(), centroids.ptr<float>(k), features.cols, best);
+
+			if (distance < best) {
+				best = distance;
+				labels[i - begin] = k;
+			}
+		}
+	}
+
+	return labels;
+}
+
+// Rank the rows of the given lists, exactly
+template <typename T>
+static vector<frame_match> scanLists(const Mat &features, const T *query, const vector<vector<int>> &members, const vector<int> &lists, int nummatches, int exclude) {
+	TopK<double> best(max(nummatches, 0));
+
+	for (size_t l = 0; l < lists.size(); l++) {
+		const vector<int> &rows = members[lists[l]];
+
+		for (size_t r = 0; r < rows.size(); r++) {
+			if (rows[r] == exclude)
+				continue;
+
+			double bound = best.threshold();
+			double score = squaredDistance(features.ptr<T>(rows[r]), query, features.cols, bound);
+
+			if (score <= bound)
+				best.push(rows[r], score);
+		}
+	}
+
+	vector<frame_match> matches = best.sorted();
+
+	for (size_t i = 0; i < matches.size(); i++) {
+		matches[i].second = sqrt(matches[i].second);
+	}
+
+	return matches;
+}
+
+FrameIndex::FrameIndex() {
+}
+
+void FrameIndex::build(const Mat &features, int lists, ThreadPool *pool) {
+	_rows = features.rows;
+	_members.clear();
+	_centroids.release();
+
+	if (features.rows == 0 || features.cols == 0)
+		return;
+
+	// An evenly spaced sample of the rows
+	int64_t budgetRows = max((int64_t)(trainingBudget / (features.cols * sizeof(float))), (int64_t)1);
+	int64_t wantedRows = (int64_t)max(lists, 1) * trainingRowsPerList;
+	int sampleRows = (int)min((int64_t)features.rows, min(wantedRows, budgetRows));
+
+	lists = min(max(lists, 1), sampleRows);
+
+	Mat sample(sampleRows, features.cols, CV_32F);
+	Mat labels;
+
+	for (int i = 0; i < sampleRows; i++) {
+		featureRowToFloat(features, (int)((int64_t)i * features.rows / sampleRows), sample.ptr<float>(i));
+	}
+
+	theRNG().state = trainingSeed;
+	kmeans(sample, lists, labels, TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 20, 1e-3), 1, KMEANS_PP_CENTERS, _centroids);
+
+	// File every row under its nearest centroid, a range of rows per worker
+	int tasks = pool != NULL ? pool->size() : 1;
+	vector<future<vector<int>>> results;
+	vector<vector<int>> assigned;
+	const Mat &centroids = _centroids;
+
+	for (int t = 0; t < tasks; t++) {
+		int begin = (int)((int64_t)features.rows * t / tasks);
+		int end = (int)((int64_t)features.rows * (t + 1) / tasks);
+
+		if (pool == NULL)
+			assigned.push_back(assignRows(features, centroids, begin, end));
+		else
+			results.push_back(pool->submit([&features, &centroids, begin, end]() {
+				return assignRows(features, centroids, begin, end);
+			}));
+	}
+
+	for (size_t t = 0; t < results.size(); t++) {
+		assigned.push_back(results[t].get());
+	}
+
+	_members.assign(_centroids.rows, vector<int>());
+
+	int row = 0;
+	for (size_t t = 0; t < assigned.size(); t++) {
+		for (size_t i = 0; i < assigned[t].size(); i++, row++) {
+			_members[assigned[t][i]].push_back(row);
+		}
+	}
+}
+
+bool FrameIndex::save(string filename) const {
+	if (!isBuilt())
+		return false;
+
+	// Written next to its final name and renamed into place, so a reader
+	// never sees half an index
+	string temporary = filename + ".tmp." + to_string(getpid());
+	BufferedWriter file;
+	IndexHeader header;
+
+	memcpy(header.magic, indexMagic, sizeof(indexMagic));
+	header.version = indexVersion;
+	header.rows = _rows;
+	header.dimensions = _centroids.cols;
+	header.lists = _centroids.rows;
+
+	if (!file.open(temporary))
+		return false;
+
+	file.write(&header, sizeof(header));
+
+	for (int k = 0; k < _centroids.rows; k++) {
+		file.write(_centroids.ptr<float>(k), _centroids.cols * sizeof(float));
+	}
+
+	for (size_t k = 0; k < _members.size(); k++) {
+		int32_t count = _members[k].size();
+
+		file.write(&count, sizeof(count));
+		file.write(_members[k].data(), _members[k].size() * sizeof(int));
+	}
+
+	if (!file.close() || rename(temporary.c_str(), filename.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool FrameIndex::load(string filename) {
+	ifstream file(filename, ios::in | ios::binary);
+	IndexHeader header;
+
+	_rows = 0;
+	_members.clear();
+	_centroids.release();
+
+	if (!file.is_open() || !file.read((char *)&header, sizeof(header)))
+		return false;
+
+	if (memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0 || header.version != indexVersion)
+		return false;
+
+	if (header.rows <= 0 || header.dimensions <= 0 || header.lists <= 0)
+		return false;
+
+	// The centroids, a count per list and a row id per row, exactly: a
+	// truncated or stale index is rebuilt rather than searched
+	file.seekg(0, ios::end);
+	uint64_t size = (uint64_t)file.tellg();
+	file.seekg(sizeof(header));
+
+	if (!file || size != sizeof(header) + ((uint64_t)header.dimensions + 1) * header.lists * sizeof(float) + (uint64_t)header.rows * sizeof(int))
+		return false;
+
+	Mat centroids(header.lists, header.dimensions, CV_32F);
+	vector<vector<int>> members(header.lists);
+	vector<bool> filed(header.rows, false);
+	int64_t total = 0;
+
+	for (int k = 0; k < header.lists; k++) {
+		if (!file.read((char *)centroids.ptr<float>(k), (streamsize)header.dimensions * sizeof(float)))
+			return false;
+	}
+
+	for (int k = 0; k < header.lists; k++) {
+		int32_t count;
+
+		if (!file.read((char *)&count, sizeof(count)) || count < 0 || count > header.rows - total)
+			return false;
+
+		members[k].resize(count);
+		total += count;
+
+		if (!file.read((char *)members[k].data(), (streamsize)count * sizeof(int)))
+			return false;
+
+		// Every row is filed under exactly one list
+		for (int i = 0; i < count; i++) {
+			int row = members[k][i];
+
+			if (row < 0 || row >= header.rows || filed[row])
+				return false;
+
+			filed[row] = true;
+		}
+	}
+
+	if (total != header.rows)
+		return false;
+
+	_rows = header.rows;
+	_centroids = centroids;
+	_members.swap(members);
+
+	return true;
+}
+
+bool FrameIndex::isBuilt() const {
+	return !_centroids.empty();
+}
+
+bool FrameIndex::fits(const Mat &features) const {
+	return isBuilt() && features.rows == _rows && features.cols == _centroids.cols;
+}
+
+int FrameIndex::lists() const {
+	return _centroids.rows;
+}
+
+int FrameIndex::rows() const {
+	return _rows;
+}
+
+int FrameIndex::dimensions() const {
+	return _centroids.cols;
+}
+
+vector<frame_match> FrameIndex::search(const Mat &features, int frameid, int nummatches, int probes) const {
+	if (frameid < 0 || frameid >= features.rows)
+		return vector<frame_match>();
+
+	return search(features, features.row(frameid), nummatches, probes, frameid);
+}
+
+vector<frame_match> FrameIndex::search(const Mat &features, const Mat &query, int nummatches, int probes, int exclude) const {
+	CV_Assert(fits(features) && query.rows == 1 && query.cols == features.cols);
+
+	vector<float> point(query.cols);
+	featureRowToFloat(query, 0, point.data());
+
+	vector<int> lists = nearestLists(point.data(), probes);
+
+	if (features.depth() == CV_16S || features.depth() == CV_32S) {
+		Mat converted = query;
+
+		if (query.type() != features.type())
+			query.convertTo(converted, features.type());
+
+		if (features.depth() == CV_16S)
+			return scanLists<short>(features, converted.ptr<short>(0), _members, lists, nummatches, exclude);
+		else
+			return scanLists<int>(features, converted.ptr<int>(0), _members, lists, nummatches, exclude);
+	}
+
+	Mat widened, converted;
+	features.convertTo(widened, CV_32S);
+	query.convertTo(converted, CV_32S);
+
+	return scanLists<int>(widened, converted.ptr<int>(0), _members, lists, nummatches, exclude);
+}
+
+int FrameIndex::defaultListCount(int rows) {
+	return max((int)round(sqrt((double)rows)), 1);
+}
+
+vector<int> FrameIndex::nearestLists(const float *query, int probes) const {
+	TopK<double> nearest(min(max(probes, 1), _centroids.rows));
+
+	for (int k = 0; k < _centroids.rows; k++) {
+		double bound = nearest.threshold();
+		double distance = squaredDistance(query, _centroids.ptr<float>(k), _centroids.cols, bound);
+
+		if (distance <= bound)
+			nearest.push(k, distance);
+	}
+
+	vector<TopK<double>::Entry> ranked = nearest.sorted();
+	vector<int> lists(ranked.size());
+
+	for (size_t i = 0; i < ranked.size(); i++) {
+		lists[i] = ranked[i].first;
+	}
+
+	return lists;
+}
+
+double matchRecall(const vector<frame_match> &approximate, const vector<frame_match> &exact) {
+	if (exact.empty())
+		return 1.0;
+
+	int found = 0;
+
+	for (size_t i = 0; i < exact.size(); i++) {
+		for (size_t j = 0; j < approximate.size(); j++) {
+			if (approximate[j].first == exact[i].first) {
+				found++;
+				break;
+			}
+		}
+	}
+
+	return (double)found / exact.size();
+}
@@ -0,0 +1,92 @@
+#ifndef FRAME_INDEX_HPP
+#define FRAME_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+#include "frame-matching.hpp"
+#include "thread-pool.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * An approximate nearest-neighbour index over the rows of a feature matrix,
+ * for matching frames without scanning every frame: an inverted file (IVF)
+ * with a k-means coarse quantizer.
+ *
+ * build() clusters the rows with cv::kmeans, trained on an evenly spaced
+ * sample of them, and files every row under its nearest centroid. A search
+ * ranks the centroids by their distance to the query, and scans the rows
+ * filed under the probes nearest ones, with the exact distances of
+ * frame-matching.hpp. The index only holds the centroids and the row numbers
+ * of each list, so searches need the feature matrix it was built from.
+ *
+ * The knobs trade recall against latency:
+ *
+ *   - lists:   more lists means fewer rows per list, so each probe scans
+ *              less; around sqrt(rows) is the usual choice, see
+ *              defaultListCount()
+ *   - probes:  scanning more lists finds more of the true matches, up to
+ *              all of them at probes == lists
+ *
+ * matchRecall() compares the matches of a search with those of
+ * findMatchingFrames, to choose them.
+ *
+ * Usage:
+ *
+ *   FrameIndex index;
+ *
+ *   if (!index.load(filename) || !index.fits(features)) {
+ *       index.build(features, FrameIndex::defaultListCount(features.rows), &pool);
+ *       index.save(filename);
+ *   }
+ *
+ *   vector<frame_match> matches = index.search(features, frameid, 10, probes);
+ */
+class FrameIndex {
+
+	public:
+		FrameIndex();
+
+		// Cluster the rows of features into (at most) lists lists
+		void build(const Mat &features, int lists, ThreadPool *pool = NULL);
+
+		// Returns false if the file can't be written or read, or isn't an index
+		bool save(string filename) const;
+		bool load(string filename);
+
+		bool isBuilt() const;
+
+		// Whether the index was built from a matrix of this size
+		bool fits(const Mat &features) const;
+
+		int lists() const;
+		int rows() const;
+		int dimensions() const;
+
+		// The nummatches rows closest to row frameid, not including it, among
+		// the rows of the probes lists nearest to it; closest first
+		vector<frame_match> search(const Mat &features, int frameid, int nummatches, int probes) const;
+
+		// The same for a query row of the same type as the features,
+		// excluding row exclude (if any)
+		vector<frame_match> search(const Mat &features, const Mat &query, int nummatches, int probes, int exclude = -1) const;
+
+		static int defaultListCount(int rows);
+
+	protected:
+		// The lists nearest to a query, nearest first
+		vector<int> nearestLists(const float *query, int probes) const;
+
+		Mat _centroids;
+		vector<vector<int>> _members;
+		int _rows = 0;
+};
+
+// The fraction of the exact matches that were also found by an approximate
+// search
+double matchRecall(const vector<frame_match> &approximate, const vector<frame_match> &exact);
+
+#endif
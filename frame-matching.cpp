@@ -0,0 +1,526 @@
+#include "frame-matching.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+
+#include "top-k.hpp"
+#include "cpu-features.hpp"
+
+// How many values are summed between checks against the bound
+static const int boundCheckInterval = 256;
+
+// The fewest values per task of a multi-threaded scan, so that small videos
+// aren't split into tasks that take less time than handing them out
+static const int minimumTaskValues = 1 << 16;
+
+// A batch of queries is compared with the rows a block at a time: blocks of
+// as many rows as fit in batchRowBudget bytes as doubles, and at most
+// batchRows, and as many queries at once as fit in batchQueryBudget bytes
+static const int batchRows = 256;
+static const size_t batchRowBudget = (size_t)4 << 20;
+static const size_t batchQueryBudget = (size_t)16 << 20;
+
+static double squaredDistanceScalar(const short *a, const short *b, int n, double bound) {
+	int64_t sum = 0;
+
+	for (int start = 0; start < n; start += boundCheckInterval) {
+		int end = min(n, start + boundCheckInterval);
+
+		// A difference fits in 32 bits, but not its square
+		for (int i = start; i < end; i++) {
+			int d = a[i] - b[i];
+			sum += (int64_t)d * d;
+		}
+
+		if (sum > bound)
+			break;
+	}
+
+	return (double)sum;
+}
+
+static double squaredDistanceScalar(const int *a, const int *b, int n, double bound) {
+	double sum = 0;
+
+	for (int start = 0; start < n; start += boundCheckInterval) {
+		int end = min(n, start + boundCheckInterval);
+
+		for (int i = start; i < end; i++) {
+			double d = (double)a[i] - b[i];
+			sum += d * d;
+		}
+
+		if (sum > bound)
+			break;
+	}
+
+	return sum;
+}
+
+static double squaredDistanceScalar(const float *a, const float *b, int n, double bound) {
+	double sum = 0;
+
+	for (int start = 0; start < n; start += boundCheckInterval) {
+		int end = min(n, start + boundCheckInterval);
+		float partial = 0;
+
+		for (int i = start; i < end; i++) {
+			float d = a[i] - b[i];
+			partial += d * d;
+		}
+
+		sum += partial;
+
+		if (sum > bound)
+			break;
+	}
+
+	return sum;
+}
+
+#ifdef HAVE_X86_SIMD
+TARGET_AVX2 static inline int64_t horizontalSum(__m256i v) {
+	__m128i sum = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	return _mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1);
+}
+
+TARGET_AVX2 static inline double horizontalSum(__m256d v) {
+	__m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+// The differences are widened to 32 bits, where they fit, and squared into
+// 64 bit lanes, so the sums are exact and equal to the scalar version's
+TARGET_AVX2 static double squaredDistanceAVX2(const short *a, const short *b, int n, double bound) {
+	int64_t sum = 0;
+	int i = 0;
+
+	while (i + 16 <= n) {
+		int end = min(n, i + boundCheckInterval);
+		__m256i even = _mm256_setzero_si256(), odd = _mm256_setzero_si256();
+
+		for (; i + 16 <= end; i += 16) {
+			__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+			__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+
+			__m256i low = _mm256_sub_epi32(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)), _mm256_cvtepi16_epi32(_mm256_castsi256_si128(y)));
+			__m256i high = _mm256_sub_epi32(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(y, 1)));
+
+			// _mm256_mul_epi32 multiplies the even 32 bit lanes
+			even = _mm256_add_epi64(even, _mm256_mul_epi32(low, low));
+			odd = _mm256_add_epi64(odd, _mm256_mul_epi32(_mm256_srli_epi64(low, 32), _mm256_srli_epi64(low, 32)));
+			even = _mm256_add_epi64(even, _mm256_mul_epi32(high, high));
+			odd = _mm256_add_epi64(odd, _mm256_mul_epi32(_mm256_srli_epi64(high, 32), _mm256_srli_epi64(high, 32)));
+		}
+
+		sum += horizontalSum(_mm256_add_epi64(even, odd));
+
+		if (sum > bound)
+			return (double)sum;
+	}
+
+	for (; i < n; i++) {
+		int d = a[i] - b[i];
+		sum += (int64_t)d * d;
+	}
+
+	return (double)sum;
+}
+
+// In double precision, which is exact for the values of any feature type
+// (16 bit values, summed over fewer than 2^20 components), so the sums are
+// equal to the scalar version's for those
+TARGET_AVX2 static double squaredDistanceAVX2(const int *a, const int *b, int n, double bound) {
+	double sum = 0;
+	int i = 0;
+
+	while (i + 8 <= n) {
+		int end = min(n, i + boundCheckInterval);
+		__m256d partial = _mm256_setzero_pd();
+
+		for (; i + 8 <= end; i += 8) {
+			__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+			__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+
+			__m256d low = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(x)), _mm256_cvtepi32_pd(_mm256_castsi256_si128(y)));
+			__m256d high = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1)), _mm256_cvtepi32_pd(_mm256_extracti128_si256(y, 1)));
+
+			partial = _mm256_add_pd(partial, _mm256_mul_pd(low, low));
+			partial = _mm256_add_pd(partial, _mm256_mul_pd(high, high));
+		}
+
+		sum += horizontalSum(partial);
+
+		if (sum > bound)
+			return sum;
+	}
+
+	for (; i < n; i++) {
+		double d = (double)a[i] - b[i];
+		sum += d * d;
+	}
+
+	return sum;
+}
+// Not summed in the same order as the scalar version, so the results may
+// differ in the last bits
+TARGET_AVX2 static double squaredDistanceAVX2(const float *a, const float *b, int n, double bound) {
+	double sum = 0;
+	int i = 0;
+
+	while (i + 8 <= n) {
+		int end = min(n, i + boundCheckInterval);
+		__m256 partial = _mm256_setzero_ps();
+
+		for (; i + 8 <= end; i += 8) {
+			__m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+			partial = _mm256_add_ps(partial, _mm256_mul_ps(d, d));
+		}
+
+		__m128 half = _mm_add_ps(_mm256_castps256_ps128(partial), _mm256_extractf128_ps(partial, 1));
+		half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+		half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+		sum += _mm_cvtss_f32(half);
+
+		if (sum > bound)
+			return sum;
+	}
+
+	for (; i < n; i++) {
+		float d = a[i] - b[i];
+		sum += d * d;
+	}
+
+	return sum;
+}
+#endif
+
+double squaredDistance(const short *a, const short *b, int n, double bound) {
+#ifdef HAVE_X86_SIMD
+	if (useAVX2())
+		return squaredDistanceAVX2(a, b, n, bound);
+#endif
+
+	return squaredDistanceScalar(a, b, n, bound);
+}
+
+double squaredDistance(const int *a, const int *b, int n, double bound) {
+#ifdef HAVE_X86_SIMD
+	if (useAVX2())
+		return squaredDistanceAVX2(a, b, n, bound);
+#endif
+
+	return squaredDistanceScalar(a, b, n, bound);
+}
+
+double squaredDistance(const float *a, const float *b, int n, double bound) {
+#ifdef HAVE_X86_SIMD
+	if (useAVX2())
+		return squaredDistanceAVX2(a, b, n, bound);
+#endif
+
+	return squaredDistanceScalar(a, b, n, bound);
+}
+
+void featureRowToFloat(const Mat &features, int row, float *values) {
+	if (features.depth() == CV_16S) {
+		const short *source = features.ptr<short>(row);
+
+		for (int j = 0; j < features.cols; j++) {
+			values[j] = source[j];
+		}
+	}
+	else if (features.depth() == CV_32S) {
+		const int *source = features.ptr<int>(row);
+
+		for (int j = 0; j < features.cols; j++) {
+			values[j] = (float)source[j];
+		}
+	}
+	else {
+		memcpy(values, features.ptr<float>(row), features.cols * sizeof(float));
+	}
+}
+
+// The best matches among rows [begin, end), as squared distances
+template <typename T>
+static TopK<double> scanRows(const Mat &features, const T *query, int exclude, int nummatches, int begin, int end) {
+	TopK<double> best(max(nummatches, 0));
+
+	for (int i = begin; i < end; i++) {
+		if (i == exclude)
+			continue;
+
+		double bound = best.threshold();
+		double score = squaredDistance(features.ptr<T>(i), query, features.cols, bound);
+
+		if (score <= bound)
+			best.push(i, score);
+	}
+
+	return best;
+}
+
+// Split the rows into contiguous ranges, one per task, and merge the best
+// matches of each
+template <typename T>
+static TopK<double> scanRows(const Mat &features, const T *query, int exclude, int nummatches, ThreadPool *pool) {
+	int tasks = 1;
+
+	if (pool != NULL && pool->size() > 1) {
+		int64_t values = (int64_t)features.rows * features.cols;
+		tasks = (int)min((int64_t)pool->size(), max(values / minimumTaskValues, (int64_t)1));
+	}
+
+	if (tasks == 1)
+		return scanRows<T>(features, query, exclude, nummatches, 0, features.rows);
+
+	vector<future<TopK<double>>> results;
+
+	for (int t = 0; t < tasks; t++) {
+		int begin = (int)((int64_t)features.rows * t / tasks);
+		int end = (int)((int64_t)features.rows * (t + 1) / tasks);
+
+		results.push_back(pool->submit([&features, query, exclude, nummatches, begin, end]() {
+			return scanRows<T>(features, query, exclude, nummatches, begin, end);
+		}));
+	}
+
+	TopK<double> best(max(nummatches, 0));
+
+	for (size_t t = 0; t < results.size(); t++) {
+		best.merge(results[t].get());
+	}
+
+	return best;
+}
+
+template <typename T>
+static vector<frame_match> findMatchingRows(const Mat &features, const T *query, int exclude, int nummatches, ThreadPool *pool) {
+	vector<frame_match> matches = scanRows<T>(features, query, exclude, nummatches, pool).sorted();
+
+	for (size_t i = 0; i < matches.size(); i++) {
+		matches[i].second = sqrt(matches[i].second);
+	}
+
+	return matches;
+}
+
+static vector<frame_match> findMatchingFrames(const Mat &features, const Mat &query, int nummatches, int exclude, ThreadPool *pool) {
+	CV_Assert(query.rows == 1 && query.cols == features.cols);
+
+	Mat rows = features, converted = query;
+
+	if (features.depth() != CV_16S && features.depth() != CV_32S)
+		features.convertTo(rows, CV_32S);
+
+	// Copied, rather than a view of the rows, so that the query doesn't
+	// depend on features staying alive while the workers scan
+	query.convertTo(converted, rows.type());
+
+	if (rows.depth() == CV_16S)
+		return findMatchingRows<short>(rows, converted.ptr<short>(0), exclude, nummatches, pool);
+
+	return findMatchingRows<int>(rows, converted.ptr<int>(0), exclude, nummatches, pool);
+}
+
+static vector<frame_match> findMatchingFrames(const Mat &features, int frameid, int nummatches, ThreadPool *pool) {
+	if (frameid < 0 || frameid >= features.rows)
+		return vector<frame_match>();
+
+	return findMatchingFrames(features, features.row(frameid), nummatches, frameid, pool);
+}
+
+vector<frame_match> findMatchingFrames(const Mat &features, int frameid, int nummatches) {
+	return findMatchingFrames(features, frameid, nummatches, NULL);
+}
+
+vector<frame_match> findMatchingFrames(const Mat &features, int frameid, int nummatches, ThreadPool &pool) {
+	return findMatchingFrames(features, frameid, nummatches, &pool);
+}
+
+vector<frame_match> findMatchingFrames(const Mat &features, const Mat &query, int nummatches, int exclude) {
+	return findMatchingFrames(features, query, nummatches, exclude, NULL);
+}
+
+vector<frame_match> findMatchingFrames(const Mat &features, const Mat &query, int nummatches, int exclude, ThreadPool &pool) {
+	return findMatchingFrames(features, query, nummatches, exclude, &pool);
+}
+
+// The squared norms of the rows of a CV_64F matrix
+static void rowNorms(const Mat &rows, vector<double> &norms) {
+	norms.resize(rows.rows);
+
+	for (int i = 0; i < rows.rows; i++) {
+		const double *row = rows.ptr<double>(i);
+		double norm = 0;
+
+		for (int j = 0; j < rows.cols; j++) {
+			norm += row[j] * row[j];
+		}
+
+		norms[i] = norm;
+	}
+}
+
+// The best matches of each of the queries (CV_64F) among rows [begin, end),
+// as squared distances. The distances of a block of rows to all the queries
+// are ||q||^2 + ||r||^2 - 2 q.r, the products coming from a single gemm.
+static vector<TopK<double>> scanBatch(const Mat &features, const Mat &queries, const vector<double> &queryNorms, const vector<int> &exclude, int nummatches, int blockRows, int begin, int end) {
+	vector<TopK<double>> best(queries.rows, TopK<double>(max(nummatches, 0)));
+	Mat block, products;
+	vector<double> norms;
+
+	for (int start = begin; start < end; start += blockRows) {
+		int stop = min(end, start + blockRows);
+
+		features.rowRange(start, stop).convertTo(block, CV_64F);
+		rowNorms(block, norms);
+
+		gemm(queries, block, -2, Mat(), 0, products, GEMM_2_T);
+
+		for (int q = 0; q < queries.rows; q++) {
+			const double *product = products.ptr<double>(q);
+			TopK<double> &heap = best[q];
+
+			for (int i = start; i < stop; i++) {
+				if (i == exclude[q])
+					continue;
+
+				// Exact for 16 bit features; for larger values, rounding
+				// could take a duplicate's distance below zero
+				double score = max(queryNorms[q] + norms[i - start] + product[i - start], 0.0);
+
+				if (score <= heap.threshold())
+					heap.push(i, score);
+			}
+		}
+	}
+
+	return best;
+}
+
+static vector<vector<frame_match>> findMatchingFrames(const Mat &features, const vector<int> &frameids, int nummatches, ThreadPool *pool) {
+	vector<vector<frame_match>> matches(frameids.size());
+	vector<int> queried;
+
+	for (size_t i = 0; i < frameids.size(); i++) {
+		if (frameids[i] >= 0 && frameids[i] < features.rows)
+			queried.push_back(i);
+	}
+
+	if (queried.empty() || features.cols == 0)
+		return matches;
+
+	size_t rowBytes = features.cols * sizeof(double);
+	int batch = (int)min(max(batchQueryBudget / rowBytes, (size_t)1), queried.size());
+	int blockRows = (int)min(max(batchRowBudget / rowBytes, (size_t)1), (size_t)batchRows);
+	int tasks = 1;
+
+	if (pool != NULL && pool->size() > 1)
+		tasks = min(pool->size(), max(features.rows / blockRows, 1));
+
+	for (size_t first = 0; first < queried.size(); first += batch) {
+		int count = min(batch, (int)(queried.size() - first));
+		Mat queries(count, features.cols, CV_64F);
+		vector<double> queryNorms;
+		vector<int> exclude(count);
+
+		for (int q = 0; q < count; q++) {
+			Mat query = queries.row(q);
+
+			exclude[q] = frameids[queried[first + q]];
+			features.row(exclude[q]).convertTo(query, CV_64F);
+		}
+
+		rowNorms(queries, queryNorms);
+
+		// Every task compares its range of rows with the whole batch
+		vector<TopK<double>> best;
+		vector<future<vector<TopK<double>>>> results;
+
+		for (int t = 0; t < tasks; t++) {
+			int begin = (int)((int64_t)features.rows * t / tasks);
+			int end = (int)((int64_t)features.rows * (t + 1) / tasks);
+
+			if (tasks == 1)
+				best = scanBatch(features, queries, queryNorms, exclude, nummatches, blockRows, begin, end);
+			else
+				results.push_back(pool->submit([&features, &queries, &queryNorms, &exclude, nummatches, blockRows, begin, end]() {
+					return scanBatch(features, queries, queryNorms, exclude, nummatches, blockRows, begin, end);
+				}));
+		}
+
+		for (size_t t = 0; t < results.size(); t++) {
+			vector<TopK<double>> partial = results[t].get();
+
+			if (best.empty()) {
+				best.swap(partial);
+				continue;
+			}
+
+			for (int q = 0; q < count; q++) {
+				best[q].merge(partial[q]);
+			}
+		}
+
+		for (int q = 0; q < count; q++) {
+			vector<frame_match> &found = matches[queried[first + q]];
+			found = best[q].sorted();
+
+			for (size_t i = 0; i < found.size(); i++) {
+				found[i].second = sqrt(found[i].second);
+			}
+		}
+	}
+
+	return matches;
+}
+
+vector<vector<frame_match>> findMatchingFrames(const Mat &features, const vector<int> &frameids, int nummatches) {
+	return findMatchingFrames(features, frameids, nummatches, NULL);
+}
+
+vector<vector<frame_match>> findMatchingFrames(const Mat &features, const vector<int> &frameids, int nummatches, ThreadPool &pool) {
+	return findMatchingFrames(features, frameids, nummatches, &pool);
+}
+
+template <typename T>
+static vector<frame_match> rerankRows(const Mat &features, const T *query, const vector<frame_match> &candidates, int nummatches) {
+	TopK<double> best(max(nummatches, 0));
+
+	for (size_t i = 0; i < candidates.size(); i++) {
+		double bound = best.threshold();
+		double score = squaredDistance(features.ptr<T>(candidates[i].first), query, features.cols, bound);
+
+		if (score <= bound)
+			best.push(candidates[i].first, score);
+	}
+
+	vector<frame_match> matches = best.sorted();
+
+	for (size_t i = 0; i < matches.size(); i++) {
+		matches[i].second = sqrt(matches[i].second);
+	}
+
+	return matches;
+}
+
+vector<frame_match> rerankMatches(const Mat &features, const Mat &query, const vector<frame_match> &candidates, int nummatches) {
+	CV_Assert(query.rows == 1 && query.cols == features.cols);
+
+	Mat rows = features, converted = query;
+
+	if (features.depth() != CV_16S && features.depth() != CV_32S)
+		features.convertTo(rows, CV_32S);
+
+	if (query.type() != rows.type())
+		query.convertTo(converted, rows.type());
+
+	if (rows.depth() == CV_16S)
+		return rerankRows<short>(rows, converted.ptr<short>(0), candidates, nummatches);
+
+	return rerankRows<int>(rows, converted.ptr<int>(0), candidates, nummatches);
+}
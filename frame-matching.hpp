@@ -0,0 +1,65 @@
+#ifndef FRAME_MATCHING_HPP
+#define FRAME_MATCHING_HPP
+
+#include <utility>
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+#include "thread-pool.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * Task 3's frame matching: the frames whose rows of features are closest to
+ * the query frame's, by Euclidean distance.
+ *
+ * The features are a (frames x components) matrix as returned by the
+ * feature extraction or viewed in a mapped feature file: CV_16S or CV_32S.
+ * Other depths are converted to CV_32S first.
+ *
+ * Only the best nummatches frames are kept, in a TopK heap (see top-k.hpp),
+ * and the distance to a frame is abandoned as soon as it exceeds the worst
+ * of them, so most frames of a long video cost a fraction of a row.
+ *
+ * The distances are computed with AVX2 where available (see
+ * cpu-features.hpp). Given a thread pool, the rows are split into one
+ * contiguous range per worker, each scanned with its own heap, and the heaps
+ * are merged; the matches are the same as those of a single-threaded scan.
+ */
+
+// A frame and its distance to the query frame
+typedef pair<int, double> frame_match;
+
+// The squared distance between two rows of n values, or some value greater
+// than bound as soon as it is known to exceed bound
+double squaredDistance(const short *a, const short *b, int n, double bound);
+double squaredDistance(const int *a, const int *b, int n, double bound);
+double squaredDistance(const float *a, const float *b, int n, double bound);
+
+// Row row of a CV_16S, CV_32S or CV_32F matrix as floats
+void featureRowToFloat(const Mat &features, int row, float *values);
+
+// The nummatches frames closest to frame frameid, closest first, not
+// including frameid itself. Fewer are returned for shorter videos.
+vector<frame_match> findMatchingFrames(const Mat &features, int frameid, int nummatches);
+vector<frame_match> findMatchingFrames(const Mat &features, int frameid, int nummatches, ThreadPool &pool);
+
+// The nummatches rows closest to a query row of the same length, which need
+// not be one of the rows, not including row exclude (if any)
+vector<frame_match> findMatchingFrames(const Mat &features, const Mat &query, int nummatches, int exclude = -1);
+vector<frame_match> findMatchingFrames(const Mat &features, const Mat &query, int nummatches, int exclude, ThreadPool &pool);
+
+// The nummatches frames closest to each of the frames frameids, as above,
+// for many queries at once: the distances of a block of queries to a block
+// of rows are computed together, with one matrix product, so each row is
+// read once per block of queries rather than once per query. Queries out of
+// range get no matches.
+vector<vector<frame_match>> findMatchingFrames(const Mat &features, const vector<int> &frameids, int nummatches);
+vector<vector<frame_match>> findMatchingFrames(const Mat &features, const vector<int> &frameids, int nummatches, ThreadPool &pool);
+
+// The nummatches of the candidate frames closest to the query row, by their
+// exact distances, e.g. to refine the matches of an approximate search
+vector<frame_match> rerankMatches(const Mat &features, const Mat &query, const vector<frame_match> &candidates, int nummatches);
+
+#endif
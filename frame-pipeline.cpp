@@ -0,0 +1,109 @@
+#include "frame-pipeline.hpp"
+
+#include <algorithm>
+
+FramePipeline::FramePipeline(VideoCapture &capture, int decodeQueueSize, int convertQueueSize)
+	: _source(capture)
+	, _decoded(decodeQueueSize)
+	, _converted(convertQueueSize) {
+}
+
+FramePipeline::~FramePipeline() {
+	// Unblock the stages if the consumer stopped early
+	_decoded.close();
+	_converted.close();
+
+	if (_decoder.joinable())
+		_decoder.join();
+
+	if (_converter.joinable())
+		_converter.join();
+}
+
+bool FramePipeline::decodeDirectly(string path) {
+	return _source.decodeDirectly(path);
+}
+
+bool FramePipeline::selectKeyframes() {
+	return _source.selectKeyframes();
+}
+
+void FramePipeline::start(const FrameSelection &frames, int frameCount) {
+	_decoder = thread(&FramePipeline::decode, this, frames, frameCount);
+	_converter = thread(&FramePipeline::convert, this);
+}
+
+bool FramePipeline::next(int &frameIndex, Mat &ychan) {
+	IndexedFrame frame;
+
+	if (!_converted.pop(frame))
+		return false;
+
+	frameIndex = frame.index;
+	ychan = frame.data;
+
+	return true;
+}
+
+void FramePipeline::decode(FrameSelection frames, int frameCount) {
+	int stop = frames.stop(frameCount);
+	int keyframes = 0;
+
+	_source.start(frames.start);
+
+	while (_source.index() + 1 < stop) {
+		// Frames between those selected are only grabbed. Keyframes are
+		// picked out by the decoder itself.
+		if (!frames.keyframesOnly && !frames.contains(_source.index() + 1)) {
+			if (!_source.grab())
+				break;
+
+			continue;
+		}
+
+		// Queued frames must not share buffers. The decoder fills a new Mat
+		// per frame, but the capture hands back a header of its own image,
+		// which the next read overwrites: that one is copied.
+		IndexedFrame frame;
+
+		if (!_source.read(frame.data))
+			break;
+
+		if (!_source.isDirect())
+			frame.data = frame.data.clone();
+
+		frame.index = _source.index();
+
+		if (frame.index >= stop)
+			break;
+
+		if (frames.keyframesOnly && keyframes++ % max(frames.stride, 1) != 0)
+			continue;
+
+		if (!_decoded.push(frame))
+			break;
+	}
+
+	_decoded.close();
+}
+
+void FramePipeline::convert() {
+	IndexedFrame frame;
+
+	while (_decoded.pop(frame)) {
+		IndexedFrame converted;
+		converted.index = frame.index;
+
+		// Obtain the Y component of the frame (the grayscale component),
+		// unless it was decoded as that
+		if (frame.data.channels() == 1)
+			converted.data = frame.data;
+		else
+			cvtColor(frame.data, converted.data, CV_BGR2GRAY);
+
+		if (!_converted.push(converted))
+			break;
+	}
+
+	_converted.close();
+}
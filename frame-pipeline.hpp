@@ -0,0 +1,73 @@
+#ifndef FRAME_PIPELINE_HPP
+#define FRAME_PIPELINE_HPP
+
+#include <thread>
+
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include "bounded-queue.hpp"
+#include "frame-source.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * The decode and colour conversion stages of the Task 1 and Task 2 drivers.
+ *
+ * A decoder thread reads frames from the capture and a converter thread
+ * extracts their Y (grayscale) components, each feeding the next stage
+ * through a bounded queue, so decoding runs concurrently with the driver's
+ * transform and write stages. The queue capacities (in frames) bound how
+ * far each stage may run ahead of the one after it.
+ *
+ * Usage:
+ *
+ *   FramePipeline pipeline(capture, decodeQueueSize, convertQueueSize);
+ *   pipeline.start(FrameSelection(), fcount);
+ *
+ *   while (pipeline.next(findex, ychan)) {
+ *       // ychan is the Y component of frame findex, owned by the caller
+ *   }
+ *
+ * next() returns false once the selected frames of the first frameCount
+ * have been delivered or the video could not be decoded any further. The
+ * frames in between are grabbed but not retrieved, so they skip the
+ * conversion stage altogether.
+ *
+ * Before start(), decodeDirectly(path) has the decoder thread read the Y
+ * components straight from the video's YUV frames where it can (see
+ * FrameSource), and the converter thread then passes them through. A
+ * selection of keyframes needs selectKeyframes() to succeed, which it only
+ * does when decoding directly.
+ */
+class FramePipeline {
+
+	public:
+		FramePipeline(VideoCapture &capture, int decodeQueueSize, int convertQueueSize);
+		~FramePipeline();
+
+		bool decodeDirectly(string path);
+		bool selectKeyframes();
+
+		void start(const FrameSelection &frames, int frameCount);
+		bool next(int &frameIndex, Mat &ychan);
+
+	protected:
+		struct IndexedFrame {
+			int index;
+			Mat data;
+		};
+
+		void decode(FrameSelection frames, int frameCount);
+		void convert();
+
+		FrameSource _source;
+		BoundedQueue<IndexedFrame> _decoded;
+		BoundedQueue<IndexedFrame> _converted;
+		thread _decoder;
+		thread _converter;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "frame-source.hpp"
+
+#include <algorithm>
+
+bool FrameSelection::isEverything() const {
+	return start <= 0 && end < 0 && stride <= 1 && !keyframesOnly;
+}
+
+bool FrameSelection::isValid() const {
+	return start >= 0 && stride >= 1 && (end < 0 || end > start);
+}
+
+int FrameSelection::stop(int frameCount) const {
+	return end >= 0 ? min(end, frameCount) : frameCount;
+}
+
+bool FrameSelection::contains(int frameIndex) const {
+	return frameIndex >= start && (frameIndex - start) % max(stride, 1) == 0;
+}
+
+int FrameSelection::count(int frameCount) const {
+	if (keyframesOnly)
+		return -1;
+
+	int frames = stop(frameCount) - start;
+
+	return frames > 0 ? (frames + max(stride, 1) - 1) / max(stride, 1) : 0;
+}
+
+string FrameSelection::suffix() const {
+	string suffix;
+
+	if (start > 0 || end >= 0)
+		suffix += "_f" + to_string(start) + "-" + (end >= 0 ? to_string(end) : "");
+
+	if (stride > 1)
+		suffix += "_s" + to_string(stride);
+
+	if (keyframesOnly)
+		suffix += "_key";
+
+	return suffix;
+}
+
+FrameSource::FrameSource(VideoCapture &capture)
+	: _capture(capture) {
+	_nextIndex = (int)_capture.get(CV_CAP_PROP_POS_FRAMES);
+}
+
+bool FrameSource::decodeDirectly(string path) {
+	if (!_decoder.open(path))
+		return false;
+
+	_nextIndex = 0;
+	return true;
+}
+
+bool FrameSource::isDirect() const {
+	return _decoder.isOpened();
+}
+
+bool FrameSource::selectKeyframes() {
+	return isDirect() && _decoder.selectKeyframes();
+}
+
+void FrameSource::start(int frameIndex) {
+	if (frameIndex == _nextIndex)
+		return;
+
+	// Starting mid-stream: this is the only place we seek
+	if (isDirect())
+		_decoder.seek(frameIndex);
+	else
+		_capture.set(CV_CAP_PROP_POS_FRAMES, frameIndex);
+
+	_nextIndex = frameIndex;
+}
+
+bool FrameSource::read(Mat &frame) {
+	if (isDirect() ? !_decoder.read(frame) : !_capture.read(frame))
+		return false;
+
+	// Keyframes are numbered by the decoder, which drops the frames between
+	// them
+	if (isDirect() && _decoder.keyframesOnly())
+		_nextIndex = _decoder.frameNumber() + 1;
+	else
+		_nextIndex++;
+
+	return true;
+}
+
+bool FrameSource::grab() {
+	if (isDirect() ? !_decoder.grab() : !_capture.grab())
+		return false;
+
+	_nextIndex++;
+	return true;
+}
+
+int FrameSource::index() const {
+	return _nextIndex - 1;
+}
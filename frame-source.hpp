@@ -0,0 +1,100 @@
+#ifndef FRAME_SOURCE_HPP
+#define FRAME_SOURCE_HPP
+
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include "luma-decoder.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * The frames of a video to extract features from: every stride-th frame of
+ * [start, end), or with keyframesOnly, every stride-th of the keyframes in
+ * that range. The default is every frame.
+ *
+ * Keyframes are only told apart when the Y components are decoded directly
+ * (see LumaDecoder); the capture doesn't say which frames are keyframes.
+ */
+struct FrameSelection {
+	int start = 0;
+
+	// One past the last frame, or -1 for the end of the video
+	int end = -1;
+
+	int stride = 1;
+	bool keyframesOnly = false;
+
+	bool isEverything() const;
+	bool isValid() const;
+
+	// One past the last frame selected from a video of frameCount frames
+	int stop(int frameCount) const;
+
+	// Whether the stride lands on frame frameIndex (keyframes aside)
+	bool contains(int frameIndex) const;
+
+	// The number of frames selected from a video of frameCount frames, or
+	// -1 if only the decoder knows, as for keyframes
+	int count(int frameCount) const;
+
+	// Tells the output files of a selection apart from those of every
+	// frame, whose names are unchanged
+	string suffix() const;
+};
+
+/*
+ * Reads the frames of a video in order, decoding every frame exactly once,
+ * for FramePipeline to convert elsewhere.
+ *
+ * Seeking a capture forces the decoder back to the previous keyframe, so the
+ * source only seeks when asked to start somewhere other than where the
+ * capture currently is.
+ *
+ * Usage:
+ *
+ *   FrameSource source(capture);
+ *   source.start(0);                 // optional, seeks only if needed
+ *
+ *   while (source.read(frame)) {
+ *       // source.index() is the index of frame
+ *   }
+ *
+ * read() decodes the next frame as is. From a capture, the frame it returns
+ * is a header of the capture's own image, overwritten by the next read, so
+ * callers that hold on to it must clone it.
+ *
+ * decodeDirectly() switches the source from the capture to a LumaDecoder of
+ * the file the capture was opened from (see luma-decoder.hpp), when the build
+ * and the video allow it. The source then starts over from frame 0, and
+ * read() returns single channel Y components instead of BGR frames. Only
+ * then can selectKeyframes() have it skip every frame but the keyframes.
+ *
+ * grab() skips a frame: it is decoded, as the frames after it may depend on
+ * it, but not retrieved from the capture (or the decoder), which saves its
+ * conversion.
+ */
+class FrameSource {
+
+	public:
+		FrameSource(VideoCapture &capture);
+
+		bool decodeDirectly(string path);
+		bool isDirect() const;
+		bool selectKeyframes();
+
+		void start(int frameIndex);
+		bool read(Mat &frame);
+		bool grab();
+
+		int index() const;
+
+	protected:
+		VideoCapture &_capture;
+		LumaDecoder _decoder;
+		int _nextIndex;
+};
+
+#endif
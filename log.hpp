@@ -0,0 +1,84 @@
+#ifndef LOG_HPP
+#define LOG_HPP
+
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+
+/*
+ * Leveled logging for the tasks' progress and debugging messages.
+ *
+ *   LOG(LOG_INFO) << "[*] Processed frame " << frameIndex;
+ *
+ * A message is only formatted if its level is enabled: for a disabled level
+ * the whole statement, including the evaluation of its arguments, is
+ * skipped after a single comparison. Each message is written to the
+ * standard error as one line, so messages logged from several threads are
+ * never interleaved, and the standard output is left to a task's results
+ * (the output file name of task1 and task2, the matches of task3).
+ *
+ * ScopedLogLevel changes the level until the end of a scope, for example to
+ * quiet the progress messages of a feature extraction:
+ *
+ *   {
+ *       ScopedLogLevel quiet(LOG_ERROR);
+ *       extracted = extractBlockFeatures(processor, capture, options, features);
+ *   }
+ */
+
+enum LogLevel {
+	LOG_ERROR,
+	LOG_INFO,
+	LOG_DEBUG
+};
+
+inline LogLevel &logLevel() {
+	static LogLevel level = LOG_INFO;
+	return level;
+}
+
+class LogLine {
+
+	public:
+		~LogLine() {
+			static mutex outputMutex;
+			lock_guard<mutex> lock(outputMutex);
+
+			cerr << _line.str() << '\n';
+		}
+
+		template <typename T>
+		LogLine &operator<<(const T &value) {
+			_line << value;
+			return *this;
+		}
+
+	protected:
+		ostringstream _line;
+};
+
+class ScopedLogLevel {
+
+	public:
+		ScopedLogLevel(LogLevel level) : _saved(logLevel()) {
+			logLevel() = level;
+		}
+
+		~ScopedLogLevel() {
+			logLevel() = _saved;
+		}
+
+		ScopedLogLevel(const ScopedLogLevel &) = delete;
+		ScopedLogLevel &operator=(const ScopedLogLevel &) = delete;
+
+	protected:
+		LogLevel _saved;
+};
+
+#define LOG(level) \
+	if ((level) > logLevel()) ; \
+	else LogLine()
+
+#endif
@@ -0,0 +1,320 @@
+#include "luma-decoder.hpp"
+
+#ifdef HAVE_LIBAV
+
+#include <cmath>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
+}
+
+struct LumaDecoder::Context {
+	AVFormatContext *format = NULL;
+	AVCodecContext *codec = NULL;
+	AVFrame *frame = NULL;
+	AVPacket *packet = NULL;
+	int stream = -1;
+
+	// After a seek, frames before this timestamp are dropped
+	int64_t skipUntil = AV_NOPTS_VALUE;
+
+	// Set once the end of the file has been sent to the decoder
+	bool draining = false;
+
+	bool keyframesOnly = false;
+	int frameNumber = -1;
+
+	~Context() {
+		av_packet_free(&packet);
+		av_frame_free(&frame);
+		avcodec_free_context(&codec);
+		avformat_close_input(&format);
+	}
+};
+
+// Whether the frames of a pixel format have an 8 bit Y plane of their own
+static bool hasLumaPlane(int format) {
+	const AVPixFmtDescriptor *descriptor = av_pix_fmt_desc_get((AVPixelFormat)format);
+
+	if (descriptor == NULL || (descriptor->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM)))
+		return false;
+
+	return descriptor->comp[0].plane == 0 && descriptor->comp[0].step == 1 && descriptor->comp[0].depth == 8 && descriptor->comp[0].shift == 0;
+}
+
+// Whether the Y plane already spans [0, 255]
+static bool isFullRange(const AVFrame *frame) {
+	switch (frame->format) {
+		case AV_PIX_FMT_YUVJ420P:
+		case AV_PIX_FMT_YUVJ422P:
+		case AV_PIX_FMT_YUVJ444P:
+		case AV_PIX_FMT_YUVJ440P:
+		case AV_PIX_FMT_GRAY8:
+			return true;
+
+		default:
+			return frame->color_range == AVCOL_RANGE_JPEG;
+	}
+}
+
+// Stretches studio range luma ([16, 235]) to [0, 255], as the conversion to
+// BGR does
+static const Mat &studioToFullRange() {
+	static Mat table = []() {
+		Mat levels(1, 256, CV_8U);
+
+		for (int i = 0; i < 256; i++) {
+			levels.at<uchar>(0, i) = saturate_cast<uchar>(round((i - 16) * 255.0 / 219.0));
+		}
+
+		return levels;
+	}();
+
+	return table;
+}
+
+LumaDecoder::LumaDecoder() {
+}
+
+LumaDecoder::~LumaDecoder() {
+}
+
+bool LumaDecoder::open(string path) {
+	close();
+
+	unique_ptr<Context> context(new Context());
+	const AVCodec *decoder = NULL;
+
+	if (avformat_open_input(&context->format, path.c_str(), NULL, NULL) < 0)
+		return false;
+
+	if (avformat_find_stream_info(context->format, NULL) < 0)
+		return false;
+
+	context->stream = av_find_best_stream(context->format, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+
+	if (context->stream < 0)
+		return false;
+
+	AVCodecParameters *parameters = context->format->streams[context->stream]->codecpar;
+	decoder = avcodec_find_decoder(parameters->codec_id);
+
+	if (decoder == NULL || !hasLumaPlane(parameters->format))
+		return false;
+
+	context->codec = avcodec_alloc_context3(decoder);
+
+	if (context->codec == NULL || avcodec_parameters_to_context(context->codec, parameters) < 0)
+		return false;
+
+	if (avcodec_open2(context->codec, decoder, NULL) < 0)
+		return false;
+
+	context->frame = av_frame_alloc();
+	context->packet = av_packet_alloc();
+
+	if (context->frame == NULL || context->packet == NULL)
+		return false;
+
+	_context = move(context);
+	return true;
+}
+
+bool LumaDecoder::isOpened() const {
+	return (bool)_context;
+}
+
+void LumaDecoder::close() {
+	_context.reset();
+}
+
+bool LumaDecoder::seek(int frameIndex) {
+	if (!isOpened())
+		return false;
+
+	Context &context = *_context;
+	AVStream *stream = context.format->streams[context.stream];
+	AVRational rate = av_guess_frame_rate(context.format, stream, NULL);
+
+	if (rate.num <= 0 || rate.den <= 0)
+		return false;
+
+	// The frame's timestamp, from the frame rate; frames within half a frame
+	// of it count as that frame
+	int64_t start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+	int64_t duration = av_rescale_q(1, av_inv_q(rate), stream->time_base);
+	int64_t target = start + av_rescale_q(frameIndex, av_inv_q(rate), stream->time_base);
+
+	if (av_seek_frame(context.format, context.stream, target, AVSEEK_FLAG_BACKWARD) < 0)
+		return false;
+
+	avcodec_flush_buffers(context.codec);
+	context.draining = false;
+	context.skipUntil = target - duration / 2;
+	context.frameNumber = frameIndex - 1;
+
+	return true;
+}
+
+bool LumaDecoder::selectKeyframes() {
+	if (!isOpened())
+		return false;
+
+	_context->codec->skip_frame = AVDISCARD_NONKEY;
+	_context->keyframesOnly = true;
+
+	return true;
+}
+
+bool LumaDecoder::keyframesOnly() const {
+	return isOpened() && _context->keyframesOnly;
+}
+
+bool LumaDecoder::read(Mat &ychan) {
+	if (!decode())
+		return false;
+
+	AVFrame *frame = _context->frame;
+
+	if (!hasLumaPlane(frame->format)) {
+		av_frame_unref(frame);
+		return false;
+	}
+
+	// The decoder's buffer, copied out (and stretched if need be) before it
+	// is handed back
+	Mat plane(frame->height, frame->width, CV_8U, frame->data[0], frame->linesize[0]);
+
+	if (isFullRange(frame))
+		plane.copyTo(ychan);
+	else
+		LUT(plane, studioToFullRange(), ychan);
+
+	av_frame_unref(frame);
+	return true;
+}
+
+bool LumaDecoder::grab() {
+	if (!decode())
+		return false;
+
+	av_frame_unref(_context->frame);
+	return true;
+}
+
+int LumaDecoder::frameNumber() const {
+	return isOpened() ? _context->frameNumber : -1;
+}
+
+bool LumaDecoder::decode() {
+	if (!isOpened())
+		return false;
+
+	Context &context = *_context;
+	AVStream *stream = context.format->streams[context.stream];
+
+	while (true) {
+		int status = avcodec_receive_frame(context.codec, context.frame);
+
+		if (status == 0) {
+			int64_t timestamp = context.frame->best_effort_timestamp;
+
+			if (context.skipUntil != AV_NOPTS_VALUE && timestamp != AV_NOPTS_VALUE && timestamp < context.skipUntil) {
+				av_frame_unref(context.frame);
+				continue;
+			}
+
+			context.skipUntil = AV_NOPTS_VALUE;
+
+			// Numbered by timestamp where there is one, and otherwise as the
+			// frame after the last
+			AVRational rate = av_guess_frame_rate(context.format, stream, NULL);
+			int64_t start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+
+			if (timestamp != AV_NOPTS_VALUE && rate.num > 0 && rate.den > 0)
+				context.frameNumber = (int)av_rescale_q(timestamp - start, stream->time_base, av_inv_q(rate));
+			else
+				context.frameNumber++;
+
+			return true;
+		}
+
+		if (status != AVERROR(EAGAIN) || context.draining)
+			return false;
+
+		// The decoder needs more input: the next packet of the video stream,
+		// or at the end of the file, an empty one to flush the frames it
+		// still holds
+		while ((status = av_read_frame(context.format, context.packet)) >= 0 && context.packet->stream_index != context.stream) {
+			av_packet_unref(context.packet);
+		}
+
+		if (status >= 0) {
+			status = avcodec_send_packet(context.codec, context.packet);
+			av_packet_unref(context.packet);
+		}
+		else {
+			context.draining = true;
+			status = avcodec_send_packet(context.codec, NULL);
+		}
+
+		if (status < 0 && status != AVERROR(EAGAIN))
+			return false;
+	}
+}
+
+#else
+
+// Without libav, open() always fails and callers read through a capture
+
+struct LumaDecoder::Context {
+};
+
+LumaDecoder::LumaDecoder() {
+}
+
+LumaDecoder::~LumaDecoder() {
+}
+
+bool LumaDecoder::open(string path) {
+	return false;
+}
+
+bool LumaDecoder::isOpened() const {
+	return false;
+}
+
+void LumaDecoder::close() {
+}
+
+bool LumaDecoder::seek(int frameIndex) {
+	return false;
+}
+
+bool LumaDecoder::selectKeyframes() {
+	return false;
+}
+
+bool LumaDecoder::keyframesOnly() const {
+	return false;
+}
+
+bool LumaDecoder::read(Mat &ychan) {
+	return false;
+}
+
+bool LumaDecoder::grab() {
+	return false;
+}
+
+int LumaDecoder::frameNumber() const {
+	return -1;
+}
+
+bool LumaDecoder::decode() {
+	return false;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef LUMA_DECODER_HPP
+#define LUMA_DECODER_HPP
+
+#include <memory>
+#include <string>
+#include "opencv2/core/core.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * Decodes the Y (luma) plane of each frame of a video straight from the
+ * codec's YUV output, with libav (FFmpeg's libavformat and libavcodec).
+ *
+ * The features of Task 1 and Task 2 only use the Y component of a frame.
+ * Reading it through a VideoCapture has the decoder's YUV converted to BGR
+ * and then back to Y by cvtColor: two full-frame conversions, with three
+ * bytes per pixel in between, for chroma that is thrown away. This reader
+ * copies the decoder's Y plane instead.
+ *
+ * The Y plane of most videos is in studio range ([16, 235]), which the BGR
+ * conversion stretches to [0, 255]; the reader does the same with a lookup
+ * table, so its frames match the grayscale frames of a capture. They are not
+ * bit for bit identical: cvtColor recomputes Y from rounded and clipped BGR
+ * values. The two differ by at most 2 levels, except in saturated colours
+ * whose BGR values clip, where cvtColor's Y is further off from the source.
+ *
+ * Only videos whose frames have an 8 bit Y plane of their own are handled:
+ * planar and semi-planar YUV, and grayscale. open() returns false for any
+ * other video, and always if the build doesn't have libav (HAVE_LIBAV, set
+ * by the WITH_LIBAV option of CMakeLists.txt); callers then read through a
+ * capture as before.
+ *
+ * The reader is opt-in twice over: WITH_LIBAV is off by default, and the
+ * tasks only decode directly with --direct-decode (or --keyframes-only).
+ * Builds with libav test it against the capture on the sample videos (see
+ * test-luma-decoder.cpp): its frame count and frame numbers, frame size,
+ * seek() and the tolerance above. Its features are cached apart from the
+ * capture's (see FeatureCache::key).
+ *
+ * With selectKeyframes(), the decoder skips every frame but the keyframes
+ * (intra-coded frames, which need no others to be decoded), and read()
+ * returns just those; frameNumber() tells which frames they are, from their
+ * timestamps.
+ *
+ * Usage:
+ *
+ *   LumaDecoder decoder;
+ *
+ *   if (decoder.open(path)) {
+ *       decoder.seek(100);    // optional
+ *
+ *       while (decoder.read(ychan)) {
+ *           // ychan is the Y component of the next frame
+ *       }
+ *   }
+ */
+class LumaDecoder {
+
+	public:
+		LumaDecoder();
+		~LumaDecoder();
+
+		bool open(string path);
+		bool isOpened() const;
+		void close();
+
+		// Continue from frame frameIndex: decoding resumes at the keyframe
+		// before it, and the frames in between are dropped
+		bool seek(int frameIndex);
+
+		// Only decode the keyframes from now on
+		bool selectKeyframes();
+		bool keyframesOnly() const;
+
+		// The Y component of the next frame, as an 8 bit single channel Mat
+		bool read(Mat &ychan);
+
+		// Decode the next frame without copying it out
+		bool grab();
+
+		// The number of the frame last read or grabbed, from its timestamp
+		int frameNumber() const;
+
+	protected:
+		// Decode the next frame into the context's frame
+		bool decode();
+
+		// The libav state, kept out of this header
+		struct Context;
+		unique_ptr<Context> _context;
+};
+
+#endif
@@ -0,0 +1,372 @@
+#include "product-quantizer.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <unistd.h>
+
+#include "top-k.hpp"
+#include "buffered-writer.hpp"
+
+static const char quantizerMagic[4] = {'F', 'P', 'Q', 'C'};
+static const int quantizerVersion = 1;
+
+// The k-means training sample: this many rows per centroid, as long as the
+// sample fits in trainingBudget bytes
+static const int trainingRowsPerCentroid = 16;
+static const size_t trainingBudget = (size_t)256 << 20;
+static const uint64_t trainingSeed = 0x5eed5eed;
+
+// How many lookups are summed between checks against the bound
+static const int boundCheckInterval = 8;
+
+// The fewest codes per task of a multi-threaded scan
+static const int minimumTaskCodes = 1 << 18;
+
+struct QuantizerHeader {
+	char magic[4];
+	int32_t version;
+	int32_t dimensions;
+	int32_t subvectors;
+	int32_t centroids;
+	int32_t rows;
+};
+
+// The codes of rows [begin, end)
+static void encodeRows(const Mat &features, const vector<Mat> &codebooks, const vector<int> &starts, Mat &codes, int begin, int end) {
+	vector<float> row(features.cols);
+
+	for (int i = begin; i < end; i++) {
+		unsigned char *code = codes.ptr<unsigned char>(i);
+		featureRowToFloat(features, i, row.data());
+
+		for (size_t m = 0; m < codebooks.size(); m++) {
+			const Mat &codebook = codebooks[m];
+			double best = numeric_limits<double>::infinity();
+			int nearest = 0;
+
+			for (int k = 0; k < codebook.rows; k++) {
+				double distance = squaredDistance(&row[starts[m]], codebook.ptr<float>(k), codebook.cols, best);
+
+				if (distance < best) {
+					best = distance;
+					nearest = k;
+				}
+			}
+
+			code[m] = (unsigned char)nearest;
+		}
+	}
+}
+
+// The best codes among rows [begin, end) by ADC, as squared distances
+static TopK<double> scanCodes(const Mat &codes, const Mat &table, int nummatches, int exclude, int begin, int end) {
+	TopK<double> best(max(nummatches, 0));
+	int subvectors = codes.cols;
+	int centroids = table.cols;
+	const float *lookup = table.ptr<float>(0);
+
+	for (int i = begin; i < end; i++) {
+		if (i == exclude)
+			continue;
+
+		const unsigned char *code = codes.ptr<unsigned char>(i);
+		double bound = best.threshold();
+		double score = 0;
+
+		for (int start = 0; start < subvectors && score <= bound; start += boundCheckInterval) {
+			int stop = min(subvectors, start + boundCheckInterval);
+			float partial = 0;
+
+			for (int m = start; m < stop; m++) {
+				partial += lookup[m * centroids + code[m]];
+			}
+
+			score += partial;
+		}
+
+		if (score <= bound)
+			best.push(i, score);
+	}
+
+	return best;
+}
+
+ProductQuantizer::ProductQuantizer() {
+}
+
+void ProductQuantizer::train(const Mat &features, int subvectors, ThreadPool *pool, int centroids) {
+	_dimensions = features.cols;
+	_subvectors = min(max(subvectors, 1), max(features.cols, 1));
+	_codebooks.clear();
+
+	if (features.rows == 0 || features.cols == 0) {
+		_centroids = 0;
+		return;
+	}
+
+	// An evenly spaced sample of the rows
+	centroids = min(max(centroids, 1), 256);
+
+	int64_t budgetRows = max((int64_t)(trainingBudget / (features.cols * sizeof(float))), (int64_t)1);
+	int64_t wantedRows = (int64_t)centroids * trainingRowsPerCentroid;
+	int sampleRows = (int)min((int64_t)features.rows, min(wantedRows, budgetRows));
+
+	_centroids = min(centroids, sampleRows);
+
+	Mat sample(sampleRows, features.cols, CV_32F);
+
+	for (int i = 0; i < sampleRows; i++) {
+		featureRowToFloat(features, (int)((int64_t)i * features.rows / sampleRows), sample.ptr<float>(i));
+	}
+
+	// The slices are clustered independently, so train them on the workers.
+	// Each starts from the same seed, so the result doesn't depend on the
+	// number of workers.
+	vector<future<Mat>> results;
+	int codebookCentroids = _centroids;
+
+	_codebooks.resize(_subvectors);
+
+	for (int m = 0; m < _subvectors; m++) {
+		int start = sliceStart(m), end = sliceStart(m + 1);
+
+		auto task = [&sample, start, end, codebookCentroids]() {
+			Mat data = sample.colRange(start, end).clone();
+			Mat labels, codebook;
+
+			theRNG().state = trainingSeed;
+			kmeans(data, codebookCentroids, labels, TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 10, 1e-3), 1, KMEANS_PP_CENTERS, codebook);
+
+			return codebook;
+		};
+
+		if (pool == NULL)
+			_codebooks[m] = task();
+		else
+			results.push_back(pool->submit(task));
+	}
+
+	for (size_t m = 0; m < results.size(); m++) {
+		_codebooks[m] = results[m].get();
+	}
+}
+
+Mat ProductQuantizer::encode(const Mat &features, ThreadPool *pool) const {
+	CV_Assert(isTrained() && features.cols == _dimensions);
+
+	Mat codes(features.rows, _subvectors, CV_8U);
+	vector<int> starts(_subvectors);
+
+	for (int m = 0; m < _subvectors; m++) {
+		starts[m] = sliceStart(m);
+	}
+
+	int tasks = pool != NULL ? pool->size() : 1;
+	vector<future<void>> results;
+
+	for (int t = 0; t < tasks; t++) {
+		int begin = (int)((int64_t)features.rows * t / tasks);
+		int end = (int)((int64_t)features.rows * (t + 1) / tasks);
+
+		if (pool == NULL)
+			encodeRows(features, _codebooks, starts, codes, begin, end);
+		else
+			results.push_back(pool->submit([this, &features, &starts, &codes, begin, end]() {
+				encodeRows(features, _codebooks, starts, codes, begin, end);
+			}));
+	}
+
+	for (size_t t = 0; t < results.size(); t++) {
+		results[t].get();
+	}
+
+	return codes;
+}
+
+bool ProductQuantizer::save(string filename, const Mat &codes) const {
+	if (!isTrained() || codes.cols != _subvectors || codes.type() != CV_8U)
+		return false;
+
+	// Renamed into place once written, so a reader never sees half a file
+	string temporary = filename + ".tmp." + to_string(getpid());
+	BufferedWriter file;
+	QuantizerHeader header;
+
+	memcpy(header.magic, quantizerMagic, sizeof(quantizerMagic));
+	header.version = quantizerVersion;
+	header.dimensions = _dimensions;
+	header.subvectors = _subvectors;
+	header.centroids = _centroids;
+	header.rows = codes.rows;
+
+	if (!file.open(temporary))
+		return false;
+
+	file.write(&header, sizeof(header));
+
+	for (int m = 0; m < _subvectors; m++) {
+		for (int k = 0; k < _centroids; k++) {
+			file.write(_codebooks[m].ptr<float>(k), _codebooks[m].cols * sizeof(float));
+		}
+	}
+
+	for (int i = 0; i < codes.rows; i++) {
+		file.write(codes.ptr<unsigned char>(i), codes.cols);
+	}
+
+	if (!file.close() || rename(temporary.c_str(), filename.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool ProductQuantizer::load(string filename, Mat &codes) {
+	ifstream file(filename, ios::in | ios::binary);
+	QuantizerHeader header;
+
+	_dimensions = _subvectors = _centroids = 0;
+	_codebooks.clear();
+
+	if (!file.is_open() || !file.read((char *)&header, sizeof(header)))
+		return false;
+
+	if (memcmp(header.magic, quantizerMagic, sizeof(quantizerMagic)) != 0 || header.version != quantizerVersion)
+		return false;
+
+	if (header.dimensions <= 0 || header.subvectors <= 0 || header.subvectors > header.dimensions
+			|| header.centroids <= 0 || header.centroids > 256 || header.rows < 0)
+		return false;
+
+	// The codebooks and a code per subvector per row, exactly: anything else
+	// is a truncated or stale file, whose rows must not be allocated
+	file.seekg(0, ios::end);
+	uint64_t size = (uint64_t)file.tellg();
+	file.seekg(sizeof(header));
+
+	if (!file || size != sizeof(header) + (uint64_t)header.centroids * header.dimensions * sizeof(float) + (uint64_t)header.rows * header.subvectors)
+		return false;
+
+	_dimensions = header.dimensions;
+	_subvectors = header.subvectors;
+	_centroids = header.centroids;
+
+	vector<Mat> codebooks(_subvectors);
+
+	for (int m = 0; m < _subvectors; m++) {
+		codebooks[m].create(_centroids, sliceStart(m + 1) - sliceStart(m), CV_32F);
+
+		for (int k = 0; k < _centroids; k++) {
+			if (!file.read((char *)codebooks[m].ptr<float>(k), (streamsize)codebooks[m].cols * sizeof(float))) {
+				_dimensions = _subvectors = _centroids = 0;
+				return false;
+			}
+		}
+	}
+
+	Mat loaded(header.rows, _subvectors, CV_8U);
+
+	for (int i = 0; i < header.rows; i++) {
+		const unsigned char *code = loaded.ptr<unsigned char>(i);
+		bool valid = (bool)file.read((char *)code, _subvectors);
+
+		// The search looks the codes up in tables of _centroids entries
+		for (int m = 0; valid && m < _subvectors; m++) {
+			valid = code[m] < _centroids;
+		}
+
+		if (!valid) {
+			_dimensions = _subvectors = _centroids = 0;
+			return false;
+		}
+	}
+
+	_codebooks.swap(codebooks);
+	codes = loaded;
+
+	return true;
+}
+
+bool ProductQuantizer::isTrained() const {
+	return !_codebooks.empty();
+}
+
+int ProductQuantizer::subvectors() const {
+	return _subvectors;
+}
+
+int ProductQuantizer::centroids() const {
+	return _centroids;
+}
+
+int ProductQuantizer::dimensions() const {
+	return _dimensions;
+}
+
+Mat ProductQuantizer::distanceTable(const Mat &query) const {
+	CV_Assert(isTrained() && query.rows == 1 && query.cols == _dimensions);
+
+	Mat table(_subvectors, _centroids, CV_32F);
+	vector<float> point(query.cols);
+
+	featureRowToFloat(query, 0, point.data());
+
+	for (int m = 0; m < _subvectors; m++) {
+		float *distances = table.ptr<float>(m);
+
+		for (int k = 0; k < _centroids; k++) {
+			distances[k] = (float)squaredDistance(&point[sliceStart(m)], _codebooks[m].ptr<float>(k), _codebooks[m].cols, numeric_limits<double>::infinity());
+		}
+	}
+
+	return table;
+}
+
+vector<frame_match> ProductQuantizer::search(const Mat &codes, const Mat &query, int nummatches, int exclude, ThreadPool *pool) const {
+	CV_Assert(codes.cols == _subvectors && codes.type() == CV_8U);
+
+	Mat table = distanceTable(query);
+	int tasks = 1;
+
+	if (pool != NULL && pool->size() > 1) {
+		int64_t values = (int64_t)codes.rows * codes.cols;
+		tasks = (int)min((int64_t)pool->size(), max(values / minimumTaskCodes, (int64_t)1));
+	}
+
+	TopK<double> best(max(nummatches, 0));
+	vector<future<TopK<double>>> results;
+
+	for (int t = 0; t < tasks; t++) {
+		int begin = (int)((int64_t)codes.rows * t / tasks);
+		int end = (int)((int64_t)codes.rows * (t + 1) / tasks);
+
+		if (tasks == 1)
+			best = scanCodes(codes, table, nummatches, exclude, begin, end);
+		else
+			results.push_back(pool->submit([&codes, &table, nummatches, exclude, begin, end]() {
+				return scanCodes(codes, table, nummatches, exclude, begin, end);
+			}));
+	}
+
+	for (size_t t = 0; t < results.size(); t++) {
+		best.merge(results[t].get());
+	}
+
+	vector<frame_match> matches = best.sorted();
+
+	for (size_t i = 0; i < matches.size(); i++) {
+		matches[i].second = sqrt(matches[i].second);
+	}
+
+	return matches;
+}
+
+int ProductQuantizer::sliceStart(int m) const {
+	return (int)((int64_t)_dimensions * m / _subvectors);
+}
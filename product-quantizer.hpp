@@ -0,0 +1,98 @@
+#ifndef PRODUCT_QUANTIZER_HPP
+#define PRODUCT_QUANTIZER_HPP
+
+#include <string>
+#include <vector>
+#include "opencv2/core/core.hpp"
+
+#include "frame-matching.hpp"
+#include "thread-pool.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * Product quantization of feature rows: a compact code for every frame, and
+ * approximate distances computed from the codes alone.
+ *
+ * The components of a row are split into subvectors consecutive slices of
+ * (nearly) equal length. Each slice has its own codebook of up to 256
+ * centroids, trained with cv::kmeans on a sample of the rows, and a row is
+ * encoded as the index of the nearest centroid of each of its slices: one
+ * byte per subvector, instead of two or four bytes per component.
+ *
+ * A search compares a query with the codes by asymmetric distance (ADC):
+ * the query itself is not quantized. The squared distances between each of
+ * its slices and every centroid of that slice's codebook are computed once,
+ * in a subvectors x centroids table, and the distance to a frame is then the
+ * sum of subvectors table lookups. The scan reads a few bytes per frame, so
+ * the codes of a whole video stay in cache.
+ *
+ * The distances are approximate. rerankMatches() (see frame-matching.hpp)
+ * re-scores the best candidates with the exact features.
+ *
+ * The codes speed up the search; they don't replace the features. Training,
+ * encoding, the query rows and the re-ranking all need the features, so
+ * task3 keeps them mapped from the feature cache as before and saves the
+ * codebooks and codes next to them, as a companion file on top of the entry.
+ * What shrinks is what a search reads, not what is stored.
+ *
+ * Usage:
+ *
+ *   ProductQuantizer quantizer;
+ *   Mat codes;
+ *
+ *   if (!quantizer.load(filename, codes) || codes.rows != features.rows) {
+ *       quantizer.train(features, subvectors, &pool);
+ *       codes = quantizer.encode(features, &pool);
+ *       quantizer.save(filename, codes);
+ *   }
+ *
+ *   vector<frame_match> matches = quantizer.search(codes, features.row(frameid), 10, frameid, &pool);
+ */
+class ProductQuantizer {
+
+	public:
+		ProductQuantizer();
+
+		// Train the codebooks of (at most) subvectors slices, with up to
+		// centroids centroids each
+		void train(const Mat &features, int subvectors, ThreadPool *pool = NULL, int centroids = 256);
+
+		// The codes of the rows of features: a (rows x subvectors) CV_8U
+		// matrix
+		Mat encode(const Mat &features, ThreadPool *pool = NULL) const;
+
+		// The codebooks and the codes of a matrix together. Returns false if
+		// the file can't be written or read, isn't a quantizer, or is
+		// truncated or corrupt: of the wrong size for its header, or with a
+		// code that isn't one of its centroids.
+		bool save(string filename, const Mat &codes) const;
+		bool load(string filename, Mat &codes);
+
+		bool isTrained() const;
+		int subvectors() const;
+		int centroids() const;
+		int dimensions() const;
+
+		// The squared distances between the slices of a query row and the
+		// centroids, as a (subvectors x centroids) CV_32F matrix
+		Mat distanceTable(const Mat &query) const;
+
+		// The nummatches codes closest to the query row by ADC, excluding
+		// row exclude (if any); closest first
+		vector<frame_match> search(const Mat &codes, const Mat &query, int nummatches, int exclude = -1, ThreadPool *pool = NULL) const;
+
+	protected:
+		// The first component of slice m; slice m ends where m + 1 starts
+		int sliceStart(int m) const;
+
+		int _dimensions = 0;
+		int _subvectors = 0;
+		int _centroids = 0;
+
+		// One (centroids x slice length) CV_32F matrix per slice
+		vector<Mat> _codebooks;
+};
+
+#endif
@@ -13,167 +13,106 @@ void DWTProcessor::setInput(int n) {
 }
 
 string DWTProcessor::getOutputFileName() {
-	return _name + "_blockdwt_" + to_string(_numSignificantWavelets) + ".bwt";
+	return _name + "_blockdwt_" + to_string(_numSignificantWavelets) + blockSizeSuffix() + frameSelectionSuffix() + ".bwt";
 }
 
-Mat DWTProcessor::generateHaarTransform(int size) {
-	Mat H = Mat::zeros(size, size, CV_32F);
-	
-	// Generate the Haar wavelet transform programmatically
-	// Source: http://www.bearcave.com/misl/misl_tech/wavelets/matrix/
-	for (int i = 0; i < size/2; i++) {
-		H.at<float>(i*2, i*2) = 0.5;
-		H.at<float>(i*2, i*2 + 1) = 0.5;
-		H.at<float>(i*2 + 1, i*2) = 0.5;
-		H.at<float>(i*2 + 1, i*2 + 1) = -0.5;
+void outputBlock(Mat data) {
+	for (int i = 0; i < data.size().height; i++) {
+		for (int j = 0; j < data.size().width; j++) {
+			cout << setw(4) << round(data.at<float>(i, j)) << " ";
+		}
+		cout << endl;
 	}
-	
-	return H;
+	cout << endl;
 }
 
-Mat DWTProcessor::generateInverseHaarTransform(int size) {
-	return 2 * generateHaarTransform(size);
+FeatureType DWTProcessor::getFeatureType() {
+	return FEATURE_BLOCK_DWT;
 }
 
-void DWTProcessor::applyDWT(Mat &matrix, int size) {
-	Mat H = generateHaarTransform(size);
-	Mat roi = matrix(Rect(0,0,size,size));
-	
-	int half = size/2;
-	
-	// 2D-DWT: 
-	//     First multiply by the Haar transform matrix (horizontal), then multiply
-	//     the transpose of that result with the Haar transform (vertical)
-	//     Then rearrange the order of the rows and columns to achieve the corret result
-	Mat transformed = (roi * H).t() * H;
-	Mat colsOrdered = transformed.clone();
-	
-	for (int i = 0; i < half; i++) {
-		transformed.col(2*i).copyTo(colsOrdered.col(i));
-		transformed.col(2*i + 1).copyTo(colsOrdered.col(i+half));
-	}
-	
-	for (int i = 0; i < half; i++) {
-		colsOrdered.row(2*i).copyTo(roi.row(i));
-		colsOrdered.row(2*i + 1).copyTo(roi.row(i+half));
-	}
+int DWTProcessor::getComponentCount() {
+	// An NxN block only has N*N coefficients
+	return min(_numSignificantWavelets, _blockSize * _blockSize);
 }
 
-void DWTProcessor::applyInverseDWT(Mat &matrix, int size) {
-	Mat IH = generateInverseHaarTransform(size);
-	Mat roi = matrix(Rect(0,0,size,size));
-	
-	int half = size/2;
-	
-	// 2D-DWT: 
-	//     First rearrange the order of the rows and columns, 
-	//     then multiply by the Haar inverse transform matrix (horizontal), then multiply
-	//     the transpose of that result with the Haar inverse transform (vertical).
-	Mat colsOrdered = roi.clone();
-	Mat transformed = roi.clone();
-	
-	for (int i = 0; i < half; i++) {
-		roi.col(i).copyTo(colsOrdered.col(2*i));
-		roi.col(i+half).copyTo(colsOrdered.col(2*i + 1));
-	}
-	
-	for (int i = 0; i < half; i++) {
-		colsOrdered.row(i).copyTo(transformed.row(2*i));
-		colsOrdered.row(i+half).copyTo(transformed.row(2*i + 1));
-	}
-	
-	Mat inverted = (transformed * IH).t() * IH;
-	inverted.copyTo(roi);
+void DWTProcessor::processBlock(Mat frame, int frameIndex, int blockX, int blockY, short *features) {
+	transformBlock(frame, frameIndex, blockX, blockY, features);
 }
 
-void outputBlock(Mat data) {
-	for (int i = 0; i < data.size().height; i++) {
-		for (int j = 0; j < data.size().width; j++) {
-			cout << setw(4) << round(data.at<float>(i, j)) << " ";
-		}
-		cout << endl;
-	}
-	cout << endl;
+void DWTProcessor::processBlockRow(const Mat &frame, int frameIndex, int blockY, short *features) {
+	transformBlockRange(frame, blockY, 0, frame.cols/_blockSize, features);
 }
 
-void DWTProcessor::processBlock(Mat frame, int frameIndex, int blockX, int blockY) {
-	cout << "[*] Processing block (" << blockX << "," << blockY << ") in frame " << frameIndex << endl;
-	
-	frame = frame(Rect(blockX*8, blockY*8, 8, 8));
-	frame.convertTo(frame, CV_32F);
-	
-	// Mat original = frame.clone();
+bool DWTProcessor::canProcessRowsConcurrently() {
+	return true;
+}
+
+void DWTProcessor::transformBlock(const Mat &frame, int frameIndex, int blockX, int blockY, short *features) {
+	LOG(LOG_DEBUG) << "[*] Processing block (" << blockX << "," << blockY << ") in frame " << frameIndex;
 	
-	// Apply the DWT enough times to obtain single coefficients
-	applyDWT(frame, 8);
-	applyDWT(frame, 4);
-	applyDWT(frame, 2);
+	transformBlockRange(frame, blockY, blockX, blockX + 1, features);
+}
+
+bool DWTProcessor::supportsBlockSize(int size) {
+	return isSupportedBlockSize(size);
+}
+
+void DWTProcessor::transformBlockRange(const Mat &frame, int blockY, int first, int last, short *features) {
+	BlockRange range = {this, frame, blockY, first, last, features};
+	dispatchBlockSize(_blockSize, range);
+}
 
-	// Count the significant DWT components
-	int counted = 0;
-	for (int d = 0; d < 16; d++) {
-		for (int x = 0; x <= d; x++) {
-			int u, v;
-			
-			// If we are on an even-numbered diagonal, iterate from the
-			// bottom-left to the top-right; otherwise, do the reverse.
-			if (d % 2 == 0) {
-				v = x;
-				u = d - x;
-			}
-			else {
-				v = d - x;
-				u = x;
-			}
-			
-			// Don't count indices along the diagonal that are not valid
-			if (u > 7 || v > 7)
-				continue;
-				
-			// Write out this component to file
-			_outfile << frameIndex << ','
-					 << blockX << ','
-					 << blockY << ','
-					 << counted << ','
-					 << round(frame.at<float>(u,v))
-					 << endl;
-			
-			counted++;
-			
-			// // Zero the non-significant components for debugging
-			// if (counted > _numSignificantWavelets)
-			// 	frame.at<float>(u,v) = 0;
-			
-			if (counted >= _numSignificantWavelets)
-				break;
+template <int N>
+void DWTProcessor::transformBlocks(const Mat &frame, int blockY, int first, int last, short *features) {
+	// The block lives on the stack, and the Haar levels run in place on it,
+	// so transforming a block allocates nothing
+	float block[N][N];
+	int components = getComponentCount();
+	
+	for (int blockX = first; blockX < last; blockX++) {
+		loadBlock<N>(frame, blockX, blockY, block);
+		
+		// float original[N][N];
+		// memcpy(original, block, sizeof(block));
+		
+		// Apply the DWT enough times to obtain single coefficients
+		BlockHaar<N>::forward(block);
+		
+		storeBlock<N>(block, features + (blockX - first) * components);
+		
+		// // Output the inverted DWT transform for debugging's sake
+		
+		// outputBlock(Mat(N, N, CV_32F, block));
+		
+		// BlockHaar<N>::inverse(block);
+		
+		// outputBlock(Mat(N, N, CV_32F, block));
+		
+		// float totaldiff = 0;
+		
+		// for (int i = 0; i < N; i++) {
+		// 	for (int j = 0; j < N; j++) {
+		// 		totaldiff += abs(original[i][j] - block[i][j]);
+		// 	}
+		// }
+		
+		// cout << totaldiff << endl;
+	}
+}
+
+template <int N>
+void DWTProcessor::loadBlock(const Mat &frame, int blockX, int blockY, float block[N][N]) {
+	for (int i = 0; i < N; i++) {
+		const uchar *row = frame.ptr<uchar>(blockY * N + i) + blockX * N;
+		
+		for (int j = 0; j < N; j++) {
+			block[i][j] = row[j];
 		}
-			
-		if (counted >= _numSignificantWavelets)
-			break;
 	}
-	
-	// // Output the inverted DWT transform for debugging's sake
-	
-	// outputBlock(frame);
-	
-	// applyInverseDWT(frame, 2);
-	// applyInverseDWT(frame, 4);
-	// applyInverseDWT(frame, 8);
-	
-	// outputBlock(frame);
-	
-	// Mat diff = original - frame;
-	// float totaldiff = 0;
-	
-	// for (int i = 0; i < 8; i++) {
-	// 	for (int j = 0; j < 8; j++) {
-	// 		float val = diff.at<float>(i, j);
-	// 		totaldiff += abs(val);
-	// 	}
-	// }
-	
-	// outputBlock(diff);
-	
-	// cout << totaldiff << endl;
 }
 
+template <int N>
+void DWTProcessor::storeBlock(const float block[N][N], short *features) {
+	// Store the significant DWT components
+	zigzagGather<N>(&block[0][0], N, getComponentCount(), features);
+}
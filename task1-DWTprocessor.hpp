@@ -2,6 +2,8 @@
 #define TASK1_DWTPROCESSOR_HPP
 
 #include "task1-blockprocessor.cpp"
+#include "block-transform.hpp"
+#include "zigzag.hpp"
 
 using namespace cv;
 using namespace std;
@@ -13,16 +15,39 @@ class DWTProcessor : public BlockProcessor {
             : BlockProcessor(capture, name) { };
         
         string getOutputFileName();
-        void processBlock(Mat frame, int frameIndex, int blockX, int blockY);
+        FeatureType getFeatureType();
+        int getComponentCount();
+        void processBlock(Mat frame, int frameIndex, int blockX, int blockY, short *features);
         void setInput(int n);
+        bool canProcessRowsConcurrently();
+        bool supportsBlockSize(int size);
         
     protected:
         void readInput();
+        void processBlockRow(const Mat &frame, int frameIndex, int blockY, short *features);
+        void transformBlock(const Mat &frame, int frameIndex, int blockX, int blockY, short *features);
         
-        Mat generateHaarTransform(int size);
-        Mat generateInverseHaarTransform(int size);
-        void applyDWT(Mat &matrix, int size);
-        void applyInverseDWT(Mat &matrix, int size);
+        // Transform the blocks first to last - 1 of a row of blocks, with the
+        // transformBlocks of the block size (see dispatchBlockSize())
+        void transformBlockRange(const Mat &frame, int blockY, int first, int last, short *features);
+        
+        struct BlockRange {
+            DWTProcessor *processor;
+            const Mat &frame;
+            int blockY;
+            int first;
+            int last;
+            short *features;
+            
+            template <int N> void run() const {
+                processor->transformBlocks<N>(frame, blockY, first, last, features);
+            }
+        };
+        
+        // The same for blocks of each size of block-transform.hpp
+        template <int N> void transformBlocks(const Mat &frame, int blockY, int first, int last, short *features);
+        template <int N> void loadBlock(const Mat &frame, int blockX, int blockY, float block[N][N]);
+        template <int N> void storeBlock(const float block[N][N], short *features);
         
         int _numSignificantWavelets;
 };
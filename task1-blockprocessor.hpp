@@ -5,10 +5,17 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <sstream>
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/core/core.hpp"
 #include "opencv2/highgui/highgui.hpp"
 
+#include "thread-pool.hpp"
+#include "feature-file.hpp"
+#include "frame-source.hpp"
+#include "buffered-writer.hpp"
+#include "log.hpp"
+
 using namespace cv;
 using namespace std;
 
@@ -16,18 +23,36 @@ using namespace std;
  * The typical life cycle of a BlockProcessor sub-class instance:
  *
  *	 - constructor(capture, name)
+ *   - exportCSV(true), dontWriteOutputFile(), keepFeatures() (optional)
  *
  *   - initialize()
  *       - readInput()
+ *       - prepare()
  *       - createOutputFile()
  *           - getOutputFileName()
+ *           - getFeatureType()
+ *           - getComponentCount()
+ *
+ *   - [loop for each frame]
+ *       - processFrame(frame, frameIndex)
+ *         or submitFrame(frame, frameIndex, pool) then writeFrame(pending)
+ *           - prepareFrame(frame)
+ *           - [loop for each row of blocks, possibly on several threads]
+ *               - processBlockRow(frame, frameIndex, blockY, features)
+ *                   - [loop for each block, by default]
+ *                       - processBlock(frame, frameIndex, blockX, blockY, features)
+ *               - exportBlockCSV(frameIndex, blockX, blockY, features, out)
+ *                 for each block, if exporting CSV
  *
- *   - [loop for each block]
- *       - processBlock(frame, frameIndex, blockX, blockY)
+ *   - finish()
+ *   - getFeatures() (if keeping the features)
  *
- *   - [end]
  *
  *
+ * The output file is a binary feature file (see feature-file.hpp) with one
+ * row of getComponentCount() values per block for every frame. With CSV
+ * export enabled, the same values are also written as text lines to a file
+ * named after the output file with ".csv" appended.
  *
  * Sub-classes of BlockProcessor should implement the following:
  *
@@ -44,16 +69,52 @@ using namespace std;
  * 			This is called by BlockProcessor's "void createOutputFile()". You
  * 			should return the name of the output file here.
  *
- *   - void processBlock(Mat frame, int frameIndex, int blockX, int blockY):
- * 			This is called by the Task 1 driver. The arguments are the pixel
- * 			contents of the current frame; the index of the current frame;
- * 			the x coordinate of the block; the y coordinate of the block.
+ *   - FeatureType getFeatureType():
+ *   - int getComponentCount():
+ *			These are called by "void createOutputFile()" once the input values
+ *			are known. Return the kind of feature and the number of values
+ *			stored for each block.
+ *
+ *   - void processBlock(Mat frame, int frameIndex, int blockX, int blockY, short *features):
+ * 			This is called by the default processBlockRow(). The arguments are
+ * 			the pixel contents of the current frame; the index of the current
+ * 			frame; the x coordinate of the block; the y coordinate of the
+ * 			block; where to store the block's features.
+ *
+ *			Note: for example, with the default 8x8 blocks, the block with
+ *			its top-left corner at pixel coordinate (32, 72) will have block
+ *			coordinates (4, 9). See setBlockSize().
+ *
+ *			You should process the block's pixels here and store its
+ *			getComponentCount() values in features. Values that are not
+ *			computed should be left alone; they are 0.
+ *
+ *   - void processBlockRow(const Mat &frame, int frameIndex, int blockY, short *features) (optional):
+ *			This is called by processFrame() once per row of blocks, with
+ *			room for the features of every block of the row, block by block.
+ *			The default calls processBlock for each block of the row.
+ *			Sub-classes should override it to walk the blocks themselves,
+ *			without a virtual call and a copy of the frame header per block.
+ *			Rows of the same frame may be processed concurrently, so this
+ *			must not modify any fields.
  *
- *			Note: for example, the 8x8 block with its top-left corner at
- *			pixel coordinate (32, 72) will have block coordinates (4, 9).
+ *   - bool canProcessRowsConcurrently() (optional):
+ *			Return true if processBlockRow has been overridden as described
+ *			above. Otherwise the rows are always processed one at a time.
  *
- *			You should process the block's pixels here and write the output
- * 			into the _outfile field.
+ *   - void prepare() (optional):
+ *			This is called by "void initialize()" once the input values are
+ *			known, for work shared by every frame such as building lookup
+ *			tables. The default does nothing.
+ *
+ *   - Mat prepareFrame(const Mat &frame) (optional):
+ *			This is called once per frame before any of its rows are
+ *			processed, for work shared by all blocks such as converting
+ *			the frame to another depth. The default returns the frame as is.
+ *
+ *   - void exportBlockCSV(int frameIndex, int blockX, int blockY, const short *features, ostream &out) (optional):
+ *			This writes the features of one block as CSV lines. The default
+ *			writes "frame,blockX,blockY,component,value" lines.
  */
 class BlockProcessor {
 
@@ -63,36 +124,278 @@ class BlockProcessor {
 			_name = name;
 		}
 
+		virtual ~BlockProcessor() {
+		}
+
 		void dontReadInput() {
 			_dontReadInput = true;
 		}
 
+		// Also write the features as text, as all of the outputs used to be
+		void exportCSV(bool enabled) {
+			_exportCSV = enabled;
+		}
+
+		// Don't create the output file, e.g. when the features are only
+		// needed in memory
+		void dontWriteOutputFile() {
+			_dontWriteOutputFile = true;
+		}
+
+		// Keep the features of every frame in memory, for getFeatures()
+		void keepFeatures() {
+			_keepFeatures = true;
+		}
+
+		// The width and height of the blocks, 8 by default. Sub-classes
+		// that support other sizes handle those of block-transform.hpp.
+		void setBlockSize(int size) {
+			_blockSize = size;
+		}
+
+		// Whether blocks of this size can be processed. The default takes
+		// any size; the block transforms only those of
+		// isSupportedBlockSize().
+		virtual bool supportsBlockSize(int size) {
+			return size > 0;
+		}
+
+		int getBlockSize() {
+			return _blockSize;
+		}
+
+		// The frames the features are extracted from, every frame by
+		// default. Only names the output file: the frames are picked by the
+		// caller.
+		void setFrameSelection(const FrameSelection &frames) {
+			_frames = frames;
+		}
+
+		// The features kept so far, one row per frame, as 32 bit signed
+		// integers
+		Mat getFeatures() {
+			Mat features;
+			int frames = _rowSize > 0 ? _kept.size() / _rowSize : 0;
+
+			Mat(frames, _rowSize, CV_16S, _kept.data()).convertTo(features, CV_32S);
+
+			return features;
+		}
+
+		// The frame number of each row of getFeatures()
+		vector<int> getFrameNumbers() {
+			return _keptFrames;
+		}
+
 		void initialize() {
 			if (!_dontReadInput)
 				this->readInput();
 
+			this->prepare();
 			this->createOutputFile();
 		};
 
+		// Complete the output files once every frame has been written.
+		// Returns false if they couldn't be created or written in full.
+		bool finish() {
+			bool written = _features.close();
+			written = _csvfile.close() && written;
+
+			return written && !_openFailed;
+		}
+
 		virtual string getOutputFileName() = 0;
-		virtual void processBlock(Mat frame, int frameIndex, int blockX, int blockY) = 0;
+		virtual FeatureType getFeatureType() = 0;
+		virtual int getComponentCount() = 0;
+		virtual void processBlock(Mat frame, int frameIndex, int blockX, int blockY, short *features) = 0;
 		virtual void setInput(int n) = 0;
 
+		// Process every block of the frame, one row of blocks at a time
+		void processFrame(const Mat &frame, int frameIndex) {
+			Mat input = this->prepareFrame(frame);
+			vector<short> features(_rowSize, 0);
+			int rowSize = (input.cols/_blockSize) * this->getComponentCount();
+
+			for (int blockY = 0; blockY < input.rows/_blockSize; blockY++) {
+				this->processBlockRow(input, frameIndex, blockY, &features[blockY * rowSize]);
+
+				if (_csvfile.isOpen()) {
+					ostringstream out;
+					exportRowCSV(input.cols/_blockSize, frameIndex, blockY, &features[blockY * rowSize], out);
+					_csvfile.write(out.str());
+				}
+			}
+
+			outputFrame(features, frameIndex);
+		}
+
+		// A frame whose rows of blocks have been handed to a thread pool. The
+		// workers store the features straight into the frame's row of
+		// features, whose buffer stays in place when the PendingFrame is
+		// moved.
+		struct PendingFrame {
+			int frameIndex;
+			Mat frame;
+			vector<short> features;
+			vector<future<string>> rows;
+		};
+
+		// Start processing every block of the frame, spreading the rows of
+		// blocks over the workers of the pool. The features are written to
+		// the output file by writeFrame(), along with each row's CSV lines
+		// if they are exported.
+		PendingFrame submitFrame(const Mat &frame, int frameIndex, ThreadPool &pool) {
+			PendingFrame pending;
+			pending.frameIndex = frameIndex;
+			pending.frame = frame;
+
+			if (pool.size() < 2 || !this->canProcessRowsConcurrently())
+				return pending;
+
+			Mat input = this->prepareFrame(frame);
+			int blocksX = input.cols/_blockSize;
+			int rowSize = blocksX * this->getComponentCount();
+
+			pending.features.assign(_rowSize, 0);
+
+			for (int blockY = 0; blockY < input.rows/_blockSize; blockY++) {
+				short *features = &pending.features[blockY * rowSize];
+
+				pending.rows.push_back(pool.submit([this, input, frameIndex, blockY, blocksX, features]() {
+					ostringstream out;
+					this->processBlockRow(input, frameIndex, blockY, features);
+
+					if (_csvfile.isOpen())
+						this->exportRowCSV(blocksX, frameIndex, blockY, features, out);
+
+					return out.str();
+				}));
+			}
+
+			return pending;
+		}
+
+		// Wait for the rows of a submitted frame and write the frame, so the
+		// output files are byte-identical to the ones written by the
+		// single-threaded processFrame(). Frames that could not be split over
+		// the pool are processed here instead. Frames must be written in the
+		// order they are to appear in the output file.
+		void writeFrame(PendingFrame &pending) {
+			if (pending.rows.empty()) {
+				processFrame(pending.frame, pending.frameIndex);
+				return;
+			}
+
+			for (size_t i = 0; i < pending.rows.size(); i++) {
+				string csv = pending.rows[i].get();
+
+				if (_csvfile.isOpen())
+					_csvfile.write(csv);
+			}
+
+			outputFrame(pending.features, pending.frameIndex);
+		}
+
+		void processFrame(const Mat &frame, int frameIndex, ThreadPool &pool) {
+			PendingFrame pending = submitFrame(frame, frameIndex, pool);
+			writeFrame(pending);
+		}
+
+		virtual bool canProcessRowsConcurrently() {
+			return false;
+		}
+
 	protected:
 		virtual void readInput() = 0;
 
+		virtual void prepare() {
+		}
+
+		virtual Mat prepareFrame(const Mat &frame) {
+			return frame;
+		}
+
+		virtual void processBlockRow(const Mat &frame, int frameIndex, int blockY, short *features) {
+			int components = this->getComponentCount();
+
+			for (int blockX = 0; blockX < frame.cols/_blockSize; blockX++) {
+				this->processBlock(frame, frameIndex, blockX, blockY, features + blockX * components);
+			}
+		}
+
+		virtual void exportBlockCSV(int frameIndex, int blockX, int blockY, const short *features, ostream &out) {
+			for (int i = 0; i < this->getComponentCount(); i++) {
+				out << frameIndex << ',' << blockX << ',' << blockY << ',' << i << ',' << features[i] << '\n';
+			}
+		}
+
+		// Tells the output files of other block sizes apart from those of
+		// the default 8x8 blocks, whose names are unchanged
+		string blockSizeSuffix() {
+			return _blockSize == 8 ? "" : "_b" + to_string(_blockSize);
+		}
+
+		// The same for the output files of a selection of the frames
+		string frameSelectionSuffix() {
+			return _frames.suffix();
+		}
+
+		void exportRowCSV(int blocksX, int frameIndex, int blockY, const short *features, ostream &out) {
+			int components = this->getComponentCount();
+
+			for (int blockX = 0; blockX < blocksX; blockX++) {
+				this->exportBlockCSV(frameIndex, blockX, blockY, features + blockX * components, out);
+			}
+		}
+
+		// Store the features of a frame. The output files are buffered, and
+		// written out a whole frame at a time.
+		void outputFrame(const vector<short> &features, int frameIndex) {
+			if (_keepFeatures) {
+				_kept.insert(_kept.end(), features.begin(), features.end());
+				_keptFrames.push_back(frameIndex);
+			}
+
+			if (_dontWriteOutputFile)
+				return;
+
+			_features.writeFrame(features.data(), frameIndex);
+			_features.flush();
+			_csvfile.flush();
+		}
+
 		void createOutputFile() {
-			//writing std file
-			_outfile.open(this->getOutputFileName());
-			//writing binary
-			//_outfileb.open(getOutputFileName(), ios::out | ios::binary);
+			int width = _capture.get(CV_CAP_PROP_FRAME_WIDTH);
+			int height = _capture.get(CV_CAP_PROP_FRAME_HEIGHT);
+
+			_rowSize = (width/_blockSize) * (height/_blockSize) * this->getComponentCount();
+
+			_openFailed = false;
+
+			if (_dontWriteOutputFile)
+				return;
+
+			if (!_features.open(this->getOutputFileName(), this->getFeatureType(), width, height, width/_blockSize, height/_blockSize, this->getComponentCount()))
+				_openFailed = true;
+
+			if (_exportCSV && !_csvfile.open(this->getOutputFileName() + ".csv"))
+				_openFailed = true;
 		}
 
 		VideoCapture _capture;
 		string _name;
-		ofstream _outfileb;
-		ofstream _outfile;
+		FeatureWriter _features;
+		BufferedWriter _csvfile;
+		vector<short> _kept;
+		vector<int> _keptFrames;
+		int _rowSize = 0;
+		int _blockSize = 8;
+		FrameSelection _frames;
 		bool _dontReadInput = false;
+		bool _dontWriteOutputFile = false;
+		bool _keepFeatures = false;
+		bool _exportCSV = false;
+		bool _openFailed = false;
 };
 
 #endif
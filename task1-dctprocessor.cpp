@@ -1,7 +1,5 @@
 #include "task1-dctprocessor.hpp"
 
-#include <cmath>
-
 void DCTProcessor::readInput() {
 	// Read the number of frequencies to keep for this DCT
 	cout << endl << "Enter the number of the frequency components to retain: ";
@@ -12,115 +10,94 @@ void DCTProcessor::setInput(int n) {
 	_numSignificantFreqs = n;
 }
 
+void DCTProcessor::setKernel(DCTKernel kernel) {
+	_kernel = kernel;
+}
+
 string DCTProcessor::getOutputFileName() {
-	return _name + "_blockdct_" + to_string(_numSignificantFreqs) + ".bct";
+	return _name + "_blockdct_" + to_string(_numSignificantFreqs) + blockSizeSuffix() + frameSelectionSuffix() + ".bct";
 }
 
-void DCTProcessor::processBlock(Mat frame, int frameIndex, int blockX, int blockY) {
-	cout << "[*] Processing block (" << blockX << "," << blockY << ") in frame " << frameIndex << endl;
-	
-	/*
-	 * From page 8 of "lossy_compression_lectures.pdf":
-	 *
-	 *  f(i,j) = pixel (i,j)
-	 * 	G(i,v) = 0.5 * C(v) * Σ(j=0..7){ cos((2j + 1)vπ / 16) * f(i,j) }
-	 * 	F(u,v) = 0.5 * C(u) * Σ(i=0..7){ cos((2i + 1)uπ / 16) * G(i,v) }
-	 *
-	 *  C(ξ) =  if (ξ = 0) then (√2/2) else (1)
-	 */
+FeatureType DCTProcessor::getFeatureType() {
+	return FEATURE_BLOCK_DCT;
+}
+
+int DCTProcessor::getComponentCount() {
+	// An NxN block only has N*N coefficients
+	return min(_numSignificantFreqs, _blockSize * _blockSize);
+}
+
+void DCTProcessor::processBlock(Mat frame, int frameIndex, int blockX, int blockY, short *features) {
+	transformBlock(frame, frameIndex, blockX, blockY, features);
+}
+
+void DCTProcessor::processBlockRow(const Mat &frame, int frameIndex, int blockY, short *features) {
+	transformBlockRange(frame, blockY, 0, frame.cols/_blockSize, features);
+}
+
+bool DCTProcessor::canProcessRowsConcurrently() {
+	return true;
+}
+
+void DCTProcessor::transformBlock(const Mat &frame, int frameIndex, int blockX, int blockY, short *features) {
+	LOG(LOG_DEBUG) << "[*] Processing block (" << blockX << "," << blockY << ") in frame " << frameIndex;
 	
-	// Create storage for f, G, and F 
-	int f[8][8] = {0};
-	double G[8][8] = {0};
-	int F[8][8] = {0};
+	transformBlockRange(frame, blockY, blockX, blockX + 1, features);
+}
+
+bool DCTProcessor::supportsBlockSize(int size) {
+	return isSupportedBlockSize(size);
+}
+
+void DCTProcessor::transformBlockRange(const Mat &frame, int blockY, int first, int last, short *features) {
+	BlockRange range = {this, frame, blockY, first, last, features};
+	dispatchBlockSize(_blockSize, range);
+}
+
+template <int N>
+void DCTProcessor::transformBlocks(const Mat &frame, int blockY, int first, int last, short *features) {
+	// Transform the blocks in one call so that the kernel can stay in its
+	// vectorized loop, then store the coefficients block by block
+	int count = last - first;
+	vector<int> f(count * N * N);
+	vector<int> F(count * N * N);
 	
-	// Copy the block data into f, normalized from [0, 255] to [-128, 127]
-	for (int i = 0; i < 8; i++) {
-		for (int j = 0; j < 8; j++) {
-			int bx = blockX * 8 + i;
-			int by = blockY * 8 + j;
-			
-			f[i][j] = frame.at<uchar>(by, bx) - 128;
-		}
+	for (int i = 0; i < count; i++) {
+		loadBlock<N>(frame, first + i, blockY, (int (*)[N])&f[i * N * N]);
 	}
 	
-	// Compute the G DCT coefficients
-	for (int i = 0; i < 8; i++) {
-		for (int v = 0; v < 8; v++) {
-			double C = 1;
-			double result = 0;
-			
-			for (int j = 0; j < 8; j++) {
-				result += cos((2*j + 1) * v * M_PI / 16) * f[i][j];
-			}
-			
-			if (v == 0)
-				C = sqrt(2.0) / 2;
-				
-			result *= 0.5 * C;
-			
-			G[i][v] = result;
-		}
+	// Compute the F DCT coefficients (see block-dct.hpp for the formulas).
+	// 8x8 blocks have the choice of kernels of block-dct.hpp.
+	if (N == 8) {
+		blockDCTBatch(_kernel, (const int (*)[8][8])f.data(), (int (*)[8][8])F.data(), count);
 	}
-	
-	// Compute the F DCT coefficients
-	for (int u = 0; u < 8; u++) {
-		for (int v = 0; v < 8; v++) {
-			double C = 1;
-			double result = 0;
-			
-			for (int i = 0; i < 8; i++) {
-				result += cos((2*i + 1) * u * M_PI / 16) * G[i][v];
-			}
-			
-			if (u == 0)
-				C = sqrt(2.0) / 2;
-				
-			result *= 0.5 * C;
-			
-			F[u][v] = round(result);
+	else {
+		for (int i = 0; i < count; i++) {
+			BlockDCT<N>::transform((const int (*)[N])&f[i * N * N], (int (*)[N])&F[i * N * N]);
 		}
 	}
 	
-	// Output the components in order of importance
-	int counted = 0;
+	int components = getComponentCount();
 	
-	for (int d = 0; d < 16; d++) {
-		for (int x = 0; x <= d; x++) {
-			int u, v;
-			
-			// If we are on an even-numbered diagonal, iterate from the
-			// bottom-left to the top-right; otherwise, do the reverse.
-			if (d % 2 == 0) {
-				v = x;
-				u = d - x;
-			}
-			else {
-				v = d - x;
-				u = x;
-			}
-			
-			// Don't count indices along the diagonal that are not valid
-			if (u > 7 || v > 7)
-				continue;
-				
-			// // Output in the form of: 
-			// // 	frame_id block_coord freq_comp_id value
-			_outfile << frameIndex << ","
-			         << blockX << ","
-					 << blockY << ","
-			         << counted << ","
-			         << round(F[u][v])
-					 << endl;
-			
-			counted++;
-			
-			if (counted >= _numSignificantFreqs)
-				break;
-		}
-			
-		if (counted >= _numSignificantFreqs)
-			break;
+	for (int i = 0; i < count; i++) {
+		storeBlock<N>((const int (*)[N])&F[i * N * N], features + i * components);
+	}
+}
+
+template <int N>
+void DCTProcessor::loadBlock(const Mat &frame, int blockX, int blockY, int f[N][N]) {
+	// Copy the block data into f, normalized from [0, 255] to [-128, 127]
+	for (int j = 0; j < N; j++) {
+		const uchar *row = frame.ptr<uchar>(blockY * N + j) + blockX * N;
 		
+		for (int i = 0; i < N; i++) {
+			f[i][j] = row[i] - 128;
+		}
 	}
-}
\ No newline at end of file
+}
+
+template <int N>
+void DCTProcessor::storeBlock(const int F[N][N], short *features) {
+	// Store the components in order of importance
+	zigzagGather<N>(&F[0][0], N, getComponentCount(), features);
+}
@@ -10,142 +10,87 @@ void HistogramProcessor::setInput(int n) {
 	_bins = n;
 }
 
+void HistogramProcessor::prepare() {
+	// Map every possible value straight to its bin, so that counting a block
+	// costs the same whatever the number of bins
+	_binTable = histogramBinTable(binOffset(), binWidth(), _bins);
+	_binOf = _binTable.data() - binOffset();
+}
+
 string HistogramProcessor::getOutputFileName() {
 	if (_isDifferenceProcessor)
-		return _name + "_diff_" + to_string(_bins) + ".dhc";
+		return _name + "_diff_" + to_string(_bins) + blockSizeSuffix() + frameSelectionSuffix() + ".dhc";
 	else
-		return _name + "_hist_" + to_string(_bins) + ".hst";
+		return _name + "_hist_" + to_string(_bins) + blockSizeSuffix() + frameSelectionSuffix() + ".hst";
+}
+
+FeatureType HistogramProcessor::getFeatureType() {
+	return _isDifferenceProcessor ? FEATURE_BLOCK_DIFFERENCE_HISTOGRAM : FEATURE_BLOCK_HISTOGRAM;
 }
 
-void HistogramProcessor::processBlock(Mat frame, int frameIndex, int blockX, int blockY) {
+int HistogramProcessor::getComponentCount() {
+	return _bins;
+}
+
+void HistogramProcessor::processBlock(Mat frame, int frameIndex, int blockX, int blockY, short *features) {
 	if (frame.depth() != CV_32S)
 		frame.convertTo(frame, CV_32S);
 
-	if (!_isDifferenceProcessor)
-	{
-				//creating bins and assigning pixel the quantized values.
-					int binIndex=256/_bins;
-					int binValue[_bins+1];
-					int binCount[_bins];
-					int i;
-
-				//initalizing binCount to zero and creating an array to store the bin values.
-				for(i =0;i<_bins;i++)
-					{
-						binValue[i]=i*binIndex;
-						binCount[i]=0;
-					}
-					binValue[i]=256;
-
-				//calculating the bin histogram for each block and writign it out to a file.
-					for (int i = 0; i < 8; i++) {
-						for (int j = 0; j < 8; j++) {
-							int bx = blockX * 8 + i;
-							int by = blockY * 8 + j;
-							for(int k=0;k<_bins;k++){
-								if(frame.at<int>(by,bx) >= binValue[k] && frame.at<int>(by,bx) < binValue[k+1])
-									binCount[k]+=1;
-							}
-						}
-					}
-
-					for(int i=0;i<_bins;i++)
-					//writing to std file
-				_outfile<<frameIndex<<','<<blockY<<','<<blockX<<','<<i<<','<<binCount[i]<<endl;
-				//writing binary
-				/*
-				_outfileb.write(((char*)(&frameIndex)),sizeof(int));
-				_outfileb.write(((char*)(&blockY)),sizeof(int));
-				_outfileb.write(((char*)(&blockX)),sizeof(int));
-				_outfileb.write(((char*)(&binValue[k])),sizeof(int));
-				_outfileb.write(((char*)(&binCount[k])),sizeof(int));
-				*/
-
-					//displaying the histogram for quantized frame blocks
-					/*for(int i=0;i<_bins;i++)
-						cout<<endl<<binCount[i]<<"\t"<<endl;
-
-					if (_isDifferenceProcessor)
-						cout << "[*] Processing block differences (" << blockX << "," << blockY << ") in frames " << frameIndex << " and " << (frameIndex + 1) << endl;
-					else
-						cout << "[*] Processing block (" << blockX << "," << blockY << ") in frame " << frameIndex << endl;
-						*/
-
-					//
-					//
-					// If _isDifferenceProcessor is true, then frame will contain the difference values
-					// for that block between frameIndex and (frameIndex + 1). The range of the values
-					// will be between -255 to 255.
-					//
-					// Otherwise, frame will contain the pixel values for the block at frameIndex. The
-					// range of values will be between 0 and 255.
-					//
-					//
-
-					// Convert the frame to 32 bit signed integers if it is not already.
-
-
-					// Debugging: print the output of the frame block;
-					/*for (int i = 0; i < 8; i++) {
-						for (int j = 0; j < 8; j++) {
-							int bx = blockX * 8 + i;
-							int by = blockY * 8 + j;
-
-							cout << frame.at<int>(by, bx) << " ";
-						}
-						cout << endl;
-					}*/
-				//	cout << endl;
-		}// if close--- normal histogram generator.
-	else
-	{
-		int binIndex=256/_bins;
-		int binValue[_bins+1];
-		int binCount[_bins];
-		int i;
-
-	//initalizing binCount to zero and creating an array to store the bin values.
-
-		for(i=0;i<_bins;i++)
-		{
-			if(i==0)
-				binValue[i]=-255;
-			else{
-			binValue[i]=binValue[i-1]+(2*binIndex);
-			}
-			binCount[i]=0;
-
-		}
-		binValue[i]=256;
-
-		//display the binValue array
-		/*
-		for(int i=0;i<=_bins;i++)
-			cout<<binValue[i]<<endl;
-		*/
-			//calculating the bin histogram for each block and writign it out to a file.
-				for (int i = 0; i < 8; i++) {
-					for (int j = 0; j < 8; j++) {
-						int bx = blockX * 8 + i;
-						int by = blockY * 8 + j;
-						for(int k=0;k<_bins;k++){
-							if(frame.at<int>(by,bx) >= binValue[k] && frame.at<int>(by,bx) < binValue[k+1])
-								binCount[k]+=1;
-						}
-					}
-				}
-
-				for(int i=0;i<_bins;i++)
-				//writing to std file
-			_outfile<<frameIndex<<','<<blockY<<','<<blockX<<','<<i<<','<<binCount[i]<<endl;
-			//writing binary
-			/*
-			_outfileb.write(((char*)(&frameIndex)),sizeof(int));
-			_outfileb.write(((char*)(&blockY)),sizeof(int));
-			_outfileb.write(((char*)(&blockX)),sizeof(int));
-			_outfileb.write(((char*)(&binValue[k])),sizeof(int));
-			_outfileb.write(((char*)(&binCount[k])),sizeof(int));
-			*/
-
-	}	//close else--- difference histogram generator
+	countBlock(frame, blockX, blockY, features);
+}
+
+Mat HistogramProcessor::prepareFrame(const Mat &frame) {
+	// Convert the frame to 32 bit signed integers once, not once per block
+	if (frame.depth() == CV_32S)
+		return frame;
+
+	Mat converted;
+	frame.convertTo(converted, CV_32S);
+
+	return converted;
+}
+
+void HistogramProcessor::processBlockRow(const Mat &frame, int frameIndex, int blockY, short *features) {
+	// Count the whole row of blocks in one call, then store the counts
+	int blocks = frame.cols/_blockSize;
+	vector<int> binCount(blocks * _bins);
+
+	histogramBlockRow(frame.ptr<int>(blockY * _blockSize), frame.step / sizeof(int), _blockSize, blocks, _binOf, _bins, binCount.data());
+
+	for (int i = 0; i < blocks * _bins; i++) {
+		features[i] = binCount[i];
+	}
+}
+
+bool HistogramProcessor::canProcessRowsConcurrently() {
+	return true;
+}
+
+int HistogramProcessor::binOffset() {
+	// Frame differences range from -255 to 255, pixel values from 0 to 255
+	return _isDifferenceProcessor ? -255 : 0;
+}
+
+int HistogramProcessor::binWidth() {
+	// Difference bins are twice as wide so that the same number of bins covers
+	// twice the range
+	int binIndex = 256/_bins;
+
+	return _isDifferenceProcessor ? 2 * binIndex : binIndex;
+}
+
+void HistogramProcessor::countBlock(const Mat &frame, int blockX, int blockY, short *features) {
+	vector<int> binCount(_bins);
+
+	histogramBlock(frame.ptr<int>(blockY * _blockSize) + blockX * _blockSize, frame.step / sizeof(int), _blockSize, _binOf, _bins, binCount.data());
+
+	for (int i = 0; i < _bins; i++) {
+		features[i] = binCount[i];
+	}
+}
+
+void HistogramProcessor::exportBlockCSV(int frameIndex, int blockX, int blockY, const short *features, ostream &out) {
+	// The histogram files have always listed the block row first
+	for (int i = 0; i < _bins; i++)
+		out << frameIndex << ',' << blockY << ',' << blockX << ',' << i << ',' << features[i] << '\n';
 }
@@ -2,6 +2,7 @@
 #define TASK1_HISTOGRAMPROCESSOR_HPP
 
 #include "task1-blockprocessor.cpp"
+#include "block-histogram.hpp"
 
 using namespace cv;
 using namespace std;
@@ -14,13 +15,25 @@ class HistogramProcessor : public BlockProcessor {
 			, _isDifferenceProcessor(isDifferenceProcessor) { };
 		
 		string getOutputFileName();
-		void processBlock(Mat frame, int frameIndex, int blockX, int blockY);
+		FeatureType getFeatureType();
+		int getComponentCount();
+		void processBlock(Mat frame, int frameIndex, int blockX, int blockY, short *features);
 		void setInput(int n);
+		bool canProcessRowsConcurrently();
 	
 	protected:
 		void readInput();
+		void prepare();
+		Mat prepareFrame(const Mat &frame);
+		void processBlockRow(const Mat &frame, int frameIndex, int blockY, short *features);
+		void exportBlockCSV(int frameIndex, int blockX, int blockY, const short *features, ostream &out);
+		void countBlock(const Mat &frame, int blockX, int blockY, short *features);
+		int binOffset();
+		int binWidth();
 		
 		int _bins;
+		vector<int> _binTable;
+		const int *_binOf;
 		bool _isDifferenceProcessor;
 };
 
@@ -9,15 +9,17 @@
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
 
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/core/core.hpp"
 #include "opencv2/highgui/highgui.hpp"
 
-#include "task1-blockprocessor.hpp"
-#include "task1-dctprocessor.hpp"
-#include "task1-dwtprocessor.hpp"
-#include "task1-histogramprocessor.hpp"
+#include "feature-extraction.hpp"
+#include "feature-cache.hpp"
+#include "cpu-features.hpp"
+#include "block-transform.hpp"
+#include "log.hpp"
 
 using namespace std;
 using namespace cv;
@@ -33,6 +35,34 @@ string removeExtension(string name) {
     }
 }
 
+// Parse a whole string as an integer
+bool parseInteger(string text, int &value) {
+	char *end;
+	long parsed = strtol(text.c_str(), &end, 10);
+	
+	if (text.empty() || *end != '\0')
+		return false;
+	
+	value = (int)parsed;
+	return true;
+}
+
+// Returns false for a name that isn't one of the kernels
+bool parseDCTKernel(string name, DCTKernel &kernel) {
+	if (name == "reference")
+		kernel = DCT_KERNEL_REFERENCE;
+	else if (name == "table")
+		kernel = DCT_KERNEL_TABLE;
+	else if (name == "float")
+		kernel = DCT_KERNEL_FLOAT;
+	else if (name == "fixed")
+		kernel = DCT_KERNEL_FIXED;
+	else
+		return false;
+	
+	return true;
+}
+
 void blockStandardOut() {
 	cout.setstate(ios::failbit);
 }
@@ -63,21 +93,85 @@ int main(int argc, const char * argv[]) {
 	int choice, n;
 	bool has_input = false;
 	
-	Mat frame, ychan;
-	Mat frame2, ychan2;
-	
 	int width, height;
-	int findex, fcount;
+	int fcount;
+	ExtractionOptions options;
 	BlockProcessor *processor;
+	
+	// The features only need to go to the output file
+	options.keepFeatures = false;
+	options.writeQueueSize = 4;
+	
+	// Previously computed feature files
+	string cacheDirectory = FeatureCache::defaultDirectory();
+	size_t cacheSize = FeatureCache::defaultCapacity();
+	bool useCache = true;
+	
+	// Separate the options from the positional arguments
+	vector<string> args;
+	
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
 		
-	if (argc == 5) {
-		path = argv[1];
-		filename = argv[2];
+		if (arg == "--threads" && i + 1 < argc)
+			options.threads = atoi(argv[++i]);
+		else if (arg == "--decode-queue" && i + 1 < argc)
+			options.decodeQueueSize = atoi(argv[++i]);
+		else if (arg == "--convert-queue" && i + 1 < argc)
+			options.convertQueueSize = atoi(argv[++i]);
+		else if (arg == "--write-queue" && i + 1 < argc)
+			options.writeQueueSize = atoi(argv[++i]);
+		else if (arg == "--dct-kernel" && i + 1 < argc) {
+			string name = argv[++i];
+			
+			if (!parseDCTKernel(name, options.dctKernel)) {
+				LOG(LOG_ERROR) << "[*] ERROR: Unknown DCT kernel " << name << ", expected reference, table, float or fixed.";
+				return -1;
+			}
+		}
+		else if (arg == "--block-size" && i + 1 < argc)
+			options.blockSize = atoi(argv[++i]);
+		else if (arg == "--no-simd")
+			simdAllowed() = false;
+		else if (arg == "--direct-decode")
+			options.directDecode = true;
+		else if (arg == "--start" && i + 1 < argc)
+			options.frames.start = atoi(argv[++i]);
+		else if (arg == "--end" && i + 1 < argc)
+			options.frames.end = atoi(argv[++i]);
+		else if (arg == "--stride" && i + 1 < argc)
+			options.frames.stride = atoi(argv[++i]);
+		else if (arg == "--keyframes-only") {
+			// Only the direct decoder can tell keyframes apart
+			options.frames.keyframesOnly = true;
+			options.directDecode = true;
+		}
+		else if (arg == "--no-cache")
+			useCache = false;
+		else if (arg == "--cache-dir" && i + 1 < argc)
+			cacheDirectory = argv[++i];
+		else if (arg == "--cache-size" && i + 1 < argc)
+			cacheSize = (size_t)atol(argv[++i]) << 20;
+		else if (arg == "--csv")
+			options.exportCSV = true;
+		else if (arg == "--verbose")
+			logLevel() = LOG_DEBUG;
+		else
+			args.push_back(arg);
+	}
+		
+	if (args.size() == 4) {
+		path = args[0];
+		filename = args[1];
 		videoname = removeExtension(filename);
-		choice = atoi(argv[3]);
-		n = atoi(argv[4]);
 		has_input = true;
 		blockStandardOut();
+		logLevel() = LOG_ERROR;
+		
+		if (!parseInteger(args[2], choice) || !parseInteger(args[3], n)) {
+			LOG(LOG_ERROR) << "[*] ERROR: Usage: task1 [options] PATH VIDEO SUB-TASK N";
+			return -1;
+		}
 	}
 	
 	if (!has_input) {
@@ -99,37 +193,37 @@ int main(int argc, const char * argv[]) {
 		cin >> choice;
 	}
 	
+	if (!isSupportedBlockSize(options.blockSize)) {
+		LOG(LOG_ERROR) << "[*] ERROR: Unsupported block size " << options.blockSize << ", expected 4, 8, 16 or 32. Exiting.";
+		return -1;
+	}
+	
 	// Open a capture object to the video
 	VideoCapture cap(path + "/" + filename);
+	options.videoPath = path + "/" + filename;
 	if (!cap.isOpened()) {
-		cout << endl << "[*] ERROR: Couldn't open the video for processing. Exiting." << endl;
+		LOG(LOG_ERROR) << "[*] ERROR: Couldn't open the video for processing. Exiting.";
+		return -1;
+	}
+	
+	if (!canSelectFrames(options)) {
+		LOG(LOG_ERROR) << "[*] ERROR: Can't select the frames: expected 0 <= --start < --end and --stride >= 1, and --keyframes-only needs a build with libav (-DWITH_LIBAV=ON, see luma-decoder.hpp). Exiting.";
 		return -1;
 	}
 	
 	fcount = cap.get(CV_CAP_PROP_FRAME_COUNT);
-	cout << "[*] Frame count for video is: " << fcount << endl;
+	LOG(LOG_INFO) << "[*] Frame count for video is: " << fcount;
 	
 	width = cap.get(CV_CAP_PROP_FRAME_WIDTH);
 	height = cap.get(CV_CAP_PROP_FRAME_HEIGHT);
 	
-	cout << "[*] Frame size for video is: " << width << " x " << height << endl;
+	LOG(LOG_INFO) << "[*] Frame size for video is: " << width << " x " << height;
 	
-	switch (choice) {
-		case 1:
-			processor = new HistogramProcessor(cap, videoname, /* isDifferenceProcessor = */ false);
-			break;
-			
-		case 2:
-			processor = new DCTProcessor(cap, videoname);
-			break;
-			
-		case 3:
-			processor = new DWTProcessor(cap, videoname);
-			break;
-			
-		case 4:
-			processor = new HistogramProcessor(cap, videoname, /* isDifferenceProcessor = */ true);
-			break;
+	processor = createBlockProcessor(cap, videoname, choice, options);
+	
+	if (processor == NULL) {
+		LOG(LOG_ERROR) << "[*] ERROR: Unknown sub-task " << choice << ". Exiting.";
+		return -1;
 	}
 	
 	if (has_input) {
@@ -139,53 +233,47 @@ int main(int argc, const char * argv[]) {
 	
 	processor->initialize();
 	
-	// Extract and process each frame
-	for (findex = 0; findex < fcount; findex++) {
-		// If we are processing the differences and this is the last frame, stop.
-		if (choice == 4 && findex + 1 == fcount)
-			break;
-			
-		cap.set(CV_CAP_PROP_POS_FRAMES, findex);
-		
-		if(!cap.read(frame)) {
-			cout << endl << "[*] ERROR: Couldn't extract frame " << findex << ". Stopping." << endl;
-			break;
-		}
-		
-		// Obtain the Y component of the frame (the grayscale component)
-		cvtColor(frame, ychan, CV_BGR2GRAY);
+	// The cache only holds feature files, so a CSV export always extracts
+	FeatureCache cache(cacheDirectory, cacheSize);
+	string outfilename = processor->getOutputFileName();
+	string key;
+	bool cached = false;
+	
+	if (!useCache)
+		cache.disable();
+	
+	key = cache.key(path + "/" + filename, outfilename, extractionDecoder(options));
+	
+	if (!options.exportCSV && cache.contains(key)) {
+		// Close the output file opened by initialize() before replacing it
+		processor->finish();
+		cached = cache.fetch(key, outfilename);
 		
-		// Get the next frame and Y component if we are doing the difference processor
-		if (choice == 4) {
-			cap.set(CV_CAP_PROP_POS_FRAMES, findex + 1);
-			if(!cap.read(frame2)) {
-				cout << endl << "[*] ERROR: Couldn't extract frame " << (findex + 1) << ". Stopping." << endl;
-				break;
-			}
-			cvtColor(frame2, ychan2, CV_BGR2GRAY);
-			
-			// Set the frame to the difference between the two.
-			ychan.convertTo(ychan, CV_32S);
-			ychan2.convertTo(ychan2, CV_32S);
-			ychan = ychan - ychan2;
+		// Evicted in the meantime: start over
+		if (!cached) {
+			processor->dontReadInput();
+			processor->initialize();
 		}
+	}
+	
+	// Incomplete features are neither cached nor reported as the output
+	if (!cached) {
+		Mat features;
 		
-		// Iterate through each 8x8 block of the frame
-		for (int blockX = 0; blockX < width/8; blockX++) {
-			for (int blockY = 0; blockY < height/8; blockY++) {
-				processor->processBlock(ychan, findex, blockX, blockY);
-			}
+		if (!extractBlockFeatures(processor, cap, options, features)) {
+			LOG(LOG_ERROR) << "[*] ERROR: Couldn't extract the features of every frame and write them out. Exiting.";
+			return -1;
 		}
 		
-		cout << "[*] Processed frame " << findex << endl;
+		cache.storeFile(key, outfilename);
 	}
 	
 	if (has_input) {
 		unblockStandardOut();
-		cout << processor->getOutputFileName();
+		cout << outfilename;
 	}
 	else {
-		cout << "[*] Wrote processed output to " << processor->getOutputFileName() << endl;
+		LOG(LOG_INFO) << "[*] Wrote processed output to " << outfilename;
 	}
 	
     return 0;
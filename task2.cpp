@@ -5,119 +5,21 @@
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
 #include <iomanip>
 
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/core/core.hpp"
 #include "opencv2/highgui/highgui.hpp"
 
+#include "feature-extraction.hpp"
+#include "feature-cache.hpp"
+#include "cpu-features.hpp"
+#include "log.hpp"
+
 using namespace std;
 using namespace cv;
 
-Mat generateHaarTransform(int size) {
-	Mat H = Mat::zeros(size, size, CV_32F);
-	
-	// Generate the Haar wavelet transform programmatically
-	// Source: http://www.bearcave.com/misl/misl_tech/wavelets/matrix/
-	for (int i = 0; i < size/2; i++) {
-		H.at<float>(i*2, i*2) = 0.5;
-		H.at<float>(i*2, i*2 + 1) = 0.5;
-		H.at<float>(i*2 + 1, i*2) = 0.5;
-		H.at<float>(i*2 + 1, i*2 + 1) = -0.5;
-	}
-	
-	return H;
-}
-
-Mat generateInverseHaarTransform(int size) {
-	return 2 * generateHaarTransform(size);
-}
-
-void applyDWT(Mat &matrix, int width, int height) {
-	Mat Hh = generateHaarTransform(width);
-	Mat Hv = generateHaarTransform(height);
-	Mat roi = matrix(Rect(0,0,width,height));
-	
-	int halfw = width/2;
-	int halfh = height/2;
-	
-	// 2D-DWT: 
-	//     First multiply by the Haar transform matrix (horizontal), then multiply
-	//     the transpose of that result with the Haar transform (vertical)
-	//     Then rearrange the order of the rows and columns to achieve the corret result
-	Mat transformed = ((roi * Hh).t() * Hv).t();
-	Mat colsOrdered = transformed.clone();
-	
-	for (int i = 0; i < halfw; i++) {
-		transformed.col(2*i).copyTo(colsOrdered.col(i));
-		transformed.col(2*i + 1).copyTo(colsOrdered.col(i+halfw));
-	}
-	
-	for (int i = 0; i < halfh; i++) {
-		colsOrdered.row(2*i).copyTo(roi.row(i));
-		colsOrdered.row(2*i + 1).copyTo(roi.row(i+halfh));
-	}
-}
-
-void processFrameDWT(VideoWriter &writer, ofstream &outfile, Mat data, int frameIndex, int width, int height, int numComponents) {
-	// Convert the data to 32 bit float version
-	data.convertTo(data, CV_32F);
-	
-	int dwtwidth = width, dwtheight = height;
-	
-	// Stop when our corner to operate on is less than 2 in any dimension
-	while (dwtwidth >= 2 && dwtheight >= 2) {
-		// Apply the DWT on the current top-left corner (width and height) of the frame
-		applyDWT(data, dwtwidth, dwtheight);
-		
-		// Halve the corner size that we will operate on
-		dwtwidth /= 2;
-		dwtheight /= 2;
-	}
-	
-	// Obtain the m most significant components
-	int counted = 0;
-	for (int d = 0; d < 16; d++) {
-		for (int x = 0; x <= d; x++) {
-			int u, v;
-			
-			// If we are on an even-numbered diagonal, iterate from the
-			// bottom-left to the top-right; otherwise, do the reverse.
-			if (d % 2 == 0) {
-				v = x;
-				u = d - x;
-			}
-			else {
-				v = d - x;
-				u = x;
-			}
-			
-			// Don't count indices along the diagonal that are not valid
-			if (u > 7 || v > 7)
-				continue;
-				
-			// Write out this component to file
-			outfile << frameIndex << ','
-					 << counted << ','
-					 << round(data.at<float>(u,v))
-					 << endl;
-			
-			counted++;
-			
-			if (counted >= numComponents)
-				break;
-		}
-			
-		if (counted >= numComponents)
-			break;
-	}
-	
-	// Convert the data back to unsigned bytes
-	data.convertTo(data, CV_8U);
-	cvtColor(data, data, CV_GRAY2BGR);
-	writer.write(data);
-}
-
 string removeExtension(string name) {
     string::size_type index = name.rfind('.');
     
@@ -129,6 +31,18 @@ string removeExtension(string name) {
     }
 }
 
+// Parse a whole string as an integer
+bool parseInteger(string text, int &value) {
+	char *end;
+	long parsed = strtol(text.c_str(), &end, 10);
+	
+	if (text.empty() || *end != '\0')
+		return false;
+	
+	value = (int)parsed;
+	return true;
+}
+
 void blockStandardOut() {
 	cout.setstate(ios::failbit);
 }
@@ -142,21 +56,75 @@ int main(int argc, const char * argv[]) {
 	int numComponents;
 	bool has_input = false;
 	
-	Mat frame, ychan;
-	
 	int width, height;
-	int findex, fcount;
+	int fcount;
+	ExtractionOptions options;
 	
 	string outfilename;
-	ofstream outfile;
 	
-	if (argc == 4) {
-		path = argv[1];
-		filename = argv[2];
+	// The features only need to go to the output file, along with the
+	// debugging video
+	options.keepFeatures = false;
+	options.writeVisualization = true;
+	
+	// Previously computed feature files
+	string cacheDirectory = FeatureCache::defaultDirectory();
+	size_t cacheSize = FeatureCache::defaultCapacity();
+	bool useCache = true;
+	
+	// Separate the options from the positional arguments
+	vector<string> args;
+	
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		
+		if (arg == "--threads" && i + 1 < argc)
+			options.threads = atoi(argv[++i]);
+		else if (arg == "--decode-queue" && i + 1 < argc)
+			options.decodeQueueSize = atoi(argv[++i]);
+		else if (arg == "--convert-queue" && i + 1 < argc)
+			options.convertQueueSize = atoi(argv[++i]);
+		else if (arg == "--write-queue" && i + 1 < argc)
+			options.writeQueueSize = atoi(argv[++i]);
+		else if (arg == "--no-simd")
+			simdAllowed() = false;
+		else if (arg == "--direct-decode")
+			options.directDecode = true;
+		else if (arg == "--start" && i + 1 < argc)
+			options.frames.start = atoi(argv[++i]);
+		else if (arg == "--end" && i + 1 < argc)
+			options.frames.end = atoi(argv[++i]);
+		else if (arg == "--stride" && i + 1 < argc)
+			options.frames.stride = atoi(argv[++i]);
+		else if (arg == "--keyframes-only") {
+			// Only the direct decoder can tell keyframes apart
+			options.frames.keyframesOnly = true;
+			options.directDecode = true;
+		}
+		else if (arg == "--no-cache")
+			useCache = false;
+		else if (arg == "--cache-dir" && i + 1 < argc)
+			cacheDirectory = argv[++i];
+		else if (arg == "--cache-size" && i + 1 < argc)
+			cacheSize = (size_t)atol(argv[++i]) << 20;
+		else if (arg == "--csv")
+			options.exportCSV = true;
+		else
+			args.push_back(arg);
+	}
+	
+	if (args.size() == 3) {
+		path = args[0];
+		filename = args[1];
 		videoname = removeExtension(filename);
-		numComponents = atoi(argv[3]);
 		has_input = true;
 		blockStandardOut();
+		logLevel() = LOG_ERROR;
+		
+		if (!parseInteger(args[2], numComponents)) {
+			LOG(LOG_ERROR) << "[*] ERROR: Usage: task2 [options] PATH VIDEO COMPONENTS";
+			return -1;
+		}
 	}
 	
     if (!has_input) {
@@ -175,47 +143,46 @@ int main(int argc, const char * argv[]) {
 	
 	// Open a capture object to the video
 	VideoCapture cap(path + "/" + filename);
+	options.videoPath = path + "/" + filename;
 	if (!cap.isOpened()) {
-		cout << endl << "[*] ERROR: Couldn't open the video for processing. Exiting." << endl;
+		LOG(LOG_ERROR) << "[*] ERROR: Couldn't open the video for processing. Exiting.";
+		return -1;
+	}
+	
+	if (!canSelectFrames(options)) {
+		LOG(LOG_ERROR) << "[*] ERROR: Can't select the frames: expected 0 <= --start < --end and --stride >= 1, and --keyframes-only needs a build with libav (-DWITH_LIBAV=ON, see luma-decoder.hpp). Exiting.";
 		return -1;
 	}
 	
 	fcount = cap.get(CV_CAP_PROP_FRAME_COUNT);
-	cout << "[*] Frame count for video is: " << fcount << endl;
+	LOG(LOG_INFO) << "[*] Frame count for video is: " << fcount;
 	
 	width = cap.get(CV_CAP_PROP_FRAME_WIDTH);
 	height = cap.get(CV_CAP_PROP_FRAME_HEIGHT);
 	
-	cout << "[*] Frame size for video is: " << width << " x " << height << endl;
+	LOG(LOG_INFO) << "[*] Frame size for video is: " << width << " x " << height;
 	
-	// Create the output file
-	outfilename = removeExtension(filename) + "_framedwt_" + to_string(numComponents) + ".fwt";
-	outfile.open(outfilename);
+	outfilename = frameFeaturesFileName(videoname, numComponents, options.frames);
 	
-	// Create the video file (debugging!)
-	string outvideoname = outfilename + ".mov";
-    int codec = CV_FOURCC('m', 'p', '4', 'v');
-    VideoWriter writer;
-    writer.open(outvideoname, codec, 24.0, Size(width,height), true);
-    if (!writer.isOpened()) {
-        cout << endl << "[*] FATAL: Couldn't open file to write video" << endl;
-        return -1;
-    }
+	// The cache only holds feature files, so a CSV export always extracts.
+	// The debugging video isn't written for cached features.
+	FeatureCache cache(cacheDirectory, cacheSize);
 	
-	// Extract and process each frame
-	for (findex = 0; findex < fcount; findex++) {
-		if(!cap.read(frame)) {
-			cout << endl << "[*] ERROR: Couldn't extract frame " << findex << ". Stopping." << endl;
-			break;
-		}
-		
-		// Obtain the Y component of the frame (the grayscale component)
-		cvtColor(frame, ychan, CV_BGR2GRAY);
+	if (!useCache)
+		cache.disable();
+	
+	string key = cache.key(path + "/" + filename, outfilename, extractionDecoder(options));
+	
+	// Incomplete features are neither cached nor reported as the output
+	if (options.exportCSV || !cache.fetch(key, outfilename)) {
+		Mat features;
 		
-		// Process the ychan component
-		processFrameDWT(writer, outfile, ychan, findex, width, height, numComponents);
+		if (!extractFrameFeatures(cap, videoname, numComponents, options, features)) {
+			LOG(LOG_ERROR) << "[*] ERROR: Couldn't extract the features of every frame and write them out. Exiting.";
+			return -1;
+		}
 		
-		cout << "[*] Processed frame " << findex << endl;
+		cache.storeFile(key, outfilename);
 	}
 	
 	if (has_input) {
@@ -223,7 +190,7 @@ int main(int argc, const char * argv[]) {
 		cout << outfilename;
 	}
 	else {
-		cout << "[*] Wrote processed output to " << outfilename << endl;
+		LOG(LOG_INFO) << "[*] Wrote processed output to " << outfilename;
 	}
 	
     return 0;
@@ -27,17 +27,27 @@
 #include <iostream>
 #include <algorithm>
 #include <iomanip>
-#include <limits>
+#include <chrono>
+#include <sstream>
+#include <cstdlib>
+#include <climits>
 
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/core/core.hpp"
 #include "opencv2/highgui/highgui.hpp"
 
+#include "feature-extraction.hpp"
+#include "feature-cache.hpp"
+#include "frame-matching.hpp"
+#include "frame-index.hpp"
+#include "product-quantizer.hpp"
+#include "feature-corpus.hpp"
+#include "block-transform.hpp"
+#include "log.hpp"
+
 using namespace std;
 using namespace cv;
 
-typedef pair<int, double> frame_match;
-
 string removeExtension(string name) {
     string::size_type index = name.rfind('.');
     
@@ -49,138 +59,308 @@ string removeExtension(string name) {
     }
 }
 
-// Sort a vector
-template <typename T>
-vector<size_t> sort_indices(vector<T> const& values) {
-    vector<size_t> indices(values.size());
+// How to find the matches: a scan of every frame, a search of an index of
+// the features, or a scan of their product quantization codes
+struct MatchOptions {
+	// The number of matches of each query frame
+	int nummatches = 10;
+	
+	bool useIndex = false;
+	
+	// 0 picks FrameIndex::defaultListCount()
+	int lists = 0;
+	int probes = 8;
+	
+	// Bytes per frame of the codes, or 0 to scan the features themselves
+	int pqSubvectors = 0;
 	
-	for (size_t i = 0; i < values.size(); i++) {
-		indices[i] = i;
+	// The number of best codes re-scored with the exact features
+	int rerank = 200;
+	
+	// Also run the exact scan, and report how many of its matches the
+	// approximate search found and how long each took
+	bool reportRecall = false;
+};
+
+vector<frame_match> searchIndex(const Mat &features, int frameid, FeatureCache &cache, const string &key, ThreadPool &pool, const MatchOptions &options, string &description) {
+	// The index is kept in the cache next to the features
+	FrameIndex index;
+	int lists = options.lists > 0 ? options.lists : FrameIndex::defaultListCount(features.rows);
+	string indexfilename = cache.companionPath(key, "_" + to_string(lists) + ".ivf");
+	
+	if (indexfilename.empty() || !index.load(indexfilename) || !index.fits(features)) {
+		index.build(features, lists, &pool);
+		
+		if (!indexfilename.empty() && index.save(indexfilename))
+			cache.evict();
 	}
+	
+	description = "Index of " + to_string(index.lists()) + " lists, " + to_string(options.probes) + " probed";
+	
+	return index.search(features, frameid, options.nummatches, options.probes);
+}
 
-    sort(begin(indices), end(indices),
-        [&](size_t a, size_t b) { return values[a] < values[b]; }
-    );
+vector<frame_match> searchCodes(const Mat &features, int frameid, FeatureCache &cache, const string &key, ThreadPool &pool, const MatchOptions &options, string &description) {
+	// The codes are kept in the cache next to the features, in addition to
+	// them: the query and the re-ranking read the features themselves
+	ProductQuantizer quantizer;
+	Mat codes;
+	string codesfilename = cache.companionPath(key, "_" + to_string(options.pqSubvectors) + ".pq");
+	
+	if (codesfilename.empty() || !quantizer.load(codesfilename, codes) || codes.rows != features.rows || quantizer.dimensions() != features.cols) {
+		quantizer.train(features, options.pqSubvectors, &pool);
+		codes = quantizer.encode(features, &pool);
+		
+		if (!codesfilename.empty() && quantizer.save(codesfilename, codes))
+			cache.evict();
+	}
+	
+	description = "Codes of " + to_string(quantizer.subvectors()) + " bytes per frame (on top of features of "
+		+ to_string(features.cols * features.elemSize()) + "), " + to_string(options.rerank) + " re-ranked";
+	
+	Mat query = features.row(frameid);
+	vector<frame_match> matches = quantizer.search(codes, query, max(options.rerank, options.nummatches), frameid, &pool);
 	
-    return indices;
+	if (options.rerank > 0)
+		return rerankMatches(features, query, matches, options.nummatches);
+	
+	matches.resize(min((int)matches.size(), options.nummatches));
+	return matches;
 }
 
-string executeTask(string command) {
-	FILE *outfp = popen(command.c_str(), "r");
+vector<frame_match> matchFrames(const Mat &features, int frameid, FeatureCache &cache, const string &key, ThreadPool &pool, const MatchOptions &options) {
+	if (!options.useIndex && options.pqSubvectors <= 0)
+		return findMatchingFrames(features, frameid, options.nummatches, pool);
 	
-	if (outfp == NULL) {
-		cout << "Error executing task. Exiting." << endl;
-		exit(-1);
+	if (frameid < 0 || frameid >= features.rows)
+		return vector<frame_match>();
+	
+	string description;
+	vector<frame_match> matches;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	
+	if (options.pqSubvectors > 0)
+		matches = searchCodes(features, frameid, cache, key, pool, options, description);
+	else
+		matches = searchIndex(features, frameid, cache, key, pool, options, description);
+	
+	chrono::duration<double, milli> searched = chrono::steady_clock::now() - start;
+	
+	if (options.reportRecall) {
+		start = chrono::steady_clock::now();
+		vector<frame_match> exact = findMatchingFrames(features, frameid, options.nummatches, pool);
+		chrono::duration<double, milli> scanned = chrono::steady_clock::now() - start;
+		
+		LOG(LOG_INFO) << "[*] " << description << ": recall " << matchRecall(matches, exact) << " in "
+			<< searched.count() << " ms, exact scan " << scanned.count() << " ms";
 	}
 	
-	char buffer[128];
-	string outfilename;
+	return matches;
+}
+
+
+// The matches of a run: the videos matched against, and the best matches of
+// each query frame among their frames
+struct MatchResults {
+	vector<string> videos;
+	vector<string> paths;
+	
+	// The video of the query frames
+	int queryVideo = 0;
+	
+	vector<int> queries;
+	vector<vector<CorpusMatch>> matches;
+};
+
+// Parse a whole string as an integer
+bool parseInteger(string text, int &value) {
+	char *end;
+	long parsed = strtol(text.c_str(), &end, 10);
 	
-	// Read from the command's stdout 
-	while (fgets(buffer, sizeof(buffer), outfp) != NULL) {
-		outfilename.append(buffer);
-	} 
+	if (text.empty() || *end != '\0')
+		return false;
 	
-	return outfilename;
+	value = (int)parsed;
+	return true;
 }
 
-Mat extractTask1Features(int task, string featurefilename, int fcount, int blockWidth, int blockHeight, int n) {
-	// Task 1(d) does not have information for the last frame
-	if (task == 4)
-		fcount--;
-		
-	// Each frame vector contains m components, so the matrix is {fcount x m}
-	// The scores/distance vector is of length fcount
-	Mat features = Mat::zeros(fcount, blockWidth * blockHeight * n, CV_32S);
-	
-	// Read the feature file line by line
-	ifstream featurefile(featurefilename);
-	int findex, blockX, blockY, compindex, compvalue;
-	string line;
-	
-	while (!featurefile.eof()) {
-		getline(featurefile, line);
-		sscanf(line.c_str(), "%d,%d,%d,%d,%d", &findex, &blockX, &blockY, &compindex, &compvalue);
-		// featurefile >> findex;
-		// featurefile >> blockX;
-		// featurefile >> blockY;
-		// featurefile >> compindex;
-		// featurefile >> compvalue;
-		
-		features.at<int>(findex, n*blockHeight*blockX + n*blockY + compindex) = compvalue;
+// The rows of the query frames: a comma separated list of frame numbers,
+// inclusive ranges "first-last" and "all". A range takes the frames in it
+// that have features, which are only some of them for a selection of the
+// frames (see FrameSelection); a single frame must have them. Returns false
+// if the text isn't such a list or a frame has no features.
+bool parseQueryFrames(string text, const VideoFeatures &video, vector<int> &rows) {
+	rows.clear();
+	
+	stringstream list(text);
+	string item;
+	
+	while (getline(list, item, ',')) {
+		int first, last;
+		string::size_type dash = item.find('-', 1);
+		
+		if (item == "all") {
+			first = 0;
+			last = INT_MAX;
+		}
+		else if (dash != string::npos) {
+			if (!parseInteger(item.substr(0, dash), first) || !parseInteger(item.substr(dash + 1), last))
+				return false;
+		}
+		else {
+			if (!parseInteger(item, first) || video.row(first) < 0)
+				return false;
+			
+			last = first;
+		}
+		
+		for (int row = 0; row < video.features.rows; row++) {
+			int frame = video.frameNumber(row);
+			
+			if (frame >= first && frame <= last)
+				rows.push_back(row);
+		}
 	}
 	
-	return features;
+	return !rows.empty();
 }
 
-Mat extractTask2Features(string featurefilename, int fcount, int m) {
-	// Each frame vector contains m components, so the matrix is {fcount x m}
-	// The scores/distance vector is of length fcount
-	Mat features = Mat::zeros(fcount, m, CV_32S);
-	
-	// Read the feature file line by line
-	ifstream featurefile(featurefilename);
-	int findex, compindex, compvalue;
-	string line;
-	
-	while (!featurefile.eof()) {
-		getline(featurefile, line);
-		sscanf(line.c_str(), "%d,%d,%d", &findex, &compindex, &compvalue);
-		// featurefile >> findex;
-		// featurefile >> compindex;
-		// featurefile >> compvalue;
-		
-		features.at<int>(findex, compindex) = compvalue;
+// Match the query frames, given by row, against the rest of their video.
+// Many frames of an exact scan are matched at once (see
+// findMatchingFrames()); the index and the codes are searched a frame at a
+// time. The results are numbered by frame.
+MatchResults matchVideoFrames(const VideoFeatures &video, const vector<int> &frameids, FeatureCache &cache, ThreadPool &pool, const MatchOptions &options) {
+	MatchResults results;
+	results.videos.push_back(video.filename);
+	results.paths.push_back(video.path);
+	results.matches.resize(frameids.size());
+	
+	for (size_t q = 0; q < frameids.size(); q++) {
+		results.queries.push_back(video.frameNumber(frameids[q]));
 	}
 	
-	return features;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<vector<frame_match>> matches;
+	
+	if (frameids.size() > 1 && !options.useIndex && options.pqSubvectors <= 0) {
+		matches = findMatchingFrames(video.features, frameids, options.nummatches, pool);
+	}
+	else {
+		for (size_t q = 0; q < frameids.size(); q++) {
+			matches.push_back(matchFrames(video.features, frameids[q], cache, video.key, pool, options));
+		}
+	}
+	
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	
+	if (frameids.size() > 1)
+		LOG(LOG_INFO) << "[*] Matched " << frameids.size() << " frames in " << elapsed.count() << " ms";
+	
+	for (size_t q = 0; q < frameids.size(); q++) {
+		for (size_t i = 0; i < matches[q].size(); i++) {
+			CorpusMatch match = {0, video.frameNumber(matches[q][i].first), matches[q][i].second};
+			results.matches[q].push_back(match);
+		}
+	}
+	
+	return results;
 }
 
-vector<frame_match> findMatchingFrames(Mat features, int frameid, int nummatches) {
-	// Create vectors for our scores and matches
-	vector<double> scores(features.rows);
-	vector<frame_match> matches(nummatches);
+// Match the query frames of one video of a corpus, given by row, against all
+// of it. The results are numbered by frame.
+MatchResults matchCorpusFrames(const FeatureCorpus &corpus, int video, const vector<int> &frameids, ThreadPool &pool, const MatchOptions &options) {
+	MatchResults results;
+	
+	for (int v = 0; v < corpus.size(); v++) {
+		results.videos.push_back(corpus.video(v).filename);
+		results.paths.push_back(corpus.video(v).path);
+	}
 	
-	// Find the query vector (for the given frameid)
-	Mat queryvector = features.row(frameid);
+	results.queryVideo = video;
 	
-	// Compute the distance scores for each 
-	for (int i = 0; i < features.rows; i++) {
-		double score;
+	for (size_t q = 0; q < frameids.size(); q++) {
+		vector<CorpusMatch> matches = corpus.search(video, frameids[q], options.nummatches, &pool);
 		
-		if (i == frameid)
-			score = numeric_limits<double>::infinity();
-		else
-			score = norm(features.row(i), queryvector);
+		for (size_t i = 0; i < matches.size(); i++) {
+			matches[i].frame = corpus.video(matches[i].video).frameNumber(matches[i].frame);
+		}
 		
-		scores[i] = score;
+		results.queries.push_back(corpus.video(video).frameNumber(frameids[q]));
+		results.matches.push_back(matches);
 	}
 	
-	// Rank the distance scores
-	vector<size_t> ranked = sort_indices(scores);
+	return results;
+}
+
+// A string as a JSON string literal
+string jsonString(const string &text) {
+	ostringstream quoted;
+	quoted << '"';
 	
-	for (int i = 0; i < nummatches; i++) {
-		matches[i] = make_pair(ranked[i], scores[ranked[i]]);
+	for (size_t i = 0; i < text.size(); i++) {
+		unsigned char c = text[i];
+		
+		if (c == '"' || c == '\\')
+			quoted << '\\' << c;
+		else if (c < 0x20)
+			quoted << "\\u" << hex << setw(4) << setfill('0') << (int)c << dec << setfill(' ');
+		else
+			quoted << c;
 	}
 	
-	return matches;
+	quoted << '"';
+	return quoted.str();
 }
 
-void displayMatches(string filename, VideoCapture &cap, int fwidth, int fheight, int frameid, vector<frame_match> &matches) {
-	Mat original, frame;
-	cap.set(CV_CAP_PROP_POS_FRAMES, frameid);
-	cap.read(original);
-	
-	vector<Mat> images(11);
-	images[0] = original;
-	
-	for (int i = 0; i < 10; i++) {
-		cap.set(CV_CAP_PROP_POS_FRAMES, matches[i].first);
-		cap.read(frame);
+// Write the matches as CSV (a line per match), JSON (an array with an
+// object per query frame) or text
+void writeMatches(ostream &out, string format, const MatchResults &results) {
+	streamsize precision = out.precision(10);
+	
+	if (format == "csv")
+		out << "query,rank,video,frame,score" << '\n';
+	else if (format == "json")
+		out << '[';
+	
+	for (size_t q = 0; q < results.queries.size(); q++) {
+		const vector<CorpusMatch> &matches = results.matches[q];
+		
+		if (format == "json")
+			out << (q > 0 ? "," : "") << "\n  {\"query\": " << results.queries[q] << ", \"matches\": [";
+		else if (format == "text")
+			out << "[*] Best matches of frame " << results.queries[q] << ":" << '\n';
 		
-		images[i + 1] = frame;
+		for (size_t i = 0; i < matches.size(); i++) {
+			const string &video = results.videos[matches[i].video];
+			
+			if (format == "csv") {
+				out << results.queries[q] << ',' << (i + 1) << ',' << video << ','
+					<< matches[i].frame << ',' << matches[i].score << '\n';
+			}
+			else if (format == "json") {
+				out << (i > 0 ? ", " : "") << "{\"video\": " << jsonString(video) << ", \"frame\": "
+					<< matches[i].frame << ", \"score\": " << matches[i].score << "}";
+			}
+			else {
+				out << "    " << (i + 1) << ". " << video << " frame " << matches[i].frame
+					<< ", score " << matches[i].score << '\n';
+			}
+		}
+		
+		if (format == "json")
+			out << "]}";
 	}
 	
+	if (format == "json")
+		out << "\n]" << '\n';
+	
+	out.precision(precision);
+	out.flush();
+}
+
+// Lay the query frame and its matches out in a grid with captions under
+// them, then write the grid to filename.jpg and/or show it
+void displayMatches(string filename, int fwidth, int fheight, const MatchResults &results, size_t query, bool write, bool show) {
 	int spacing = 20;
 	int fontheight = 80;
 	
@@ -192,130 +372,368 @@ void displayMatches(string filename, VideoCapture &cap, int fwidth, int fheight,
 	
 	Mat combined(combheight, combwidth, CV_8UC3, Scalar(255,255,255));
 	
-	for (int i = 0; i < 11; i++) {
+	// Up to 10 matches, fewer for very short videos
+	const vector<CorpusMatch> &matches = results.matches[query];
+	int shown = min((int)matches.size(), 10);
+	
+	for (int i = 0; i < shown + 1; i++) {
 		int imcol = i % 4;
 		int imrow = i / 4;
 		
 		int x = spacing + imcol*(width+spacing);
 		int y = spacing + imrow*(height+fontheight+spacing);
 		
-		Mat roi = combined(Rect(x + (width - fwidth)/2, y, fwidth, fheight));
-		images[i].copyTo(roi);
-		
-		// Write the match data.
-		string line1, line2, line3;
+		int video = i == 0 ? results.queryVideo : matches[i - 1].video;
+		int frameid = i == 0 ? results.queries[query] : matches[i - 1].frame;
+		vector<string> captions;
 		
 		if (i == 0) {
-			line1 = "Reference Frame: " + to_string(frameid);
+			captions.push_back("Reference Frame: " + to_string(frameid));
 		}
 		else {
-			frame_match match = matches[i - 1];
-			line1 = "Match: " + to_string(i);
-			line2 = "Frame: " + to_string(match.first);
-			line3 = "Score: " + to_string(match.second);
+			captions.push_back("Match: " + to_string(i));
+			
+			if (results.videos.size() == 1)
+				captions.push_back("Frame: " + to_string(frameid));
+			else
+				captions.push_back(results.videos[video] + ": " + to_string(frameid));
+			
+			captions.push_back("Score: " + to_string(matches[i - 1].score));
 		}
 		
-		// Center the label
-		int baseline;
-		Size textsize1 = getTextSize(line1, CV_FONT_HERSHEY_PLAIN, 1, 1, &baseline);
-		Size textsize2 = getTextSize(line2, CV_FONT_HERSHEY_PLAIN, 1, 1, &baseline);
-		Size textsize3 = getTextSize(line3, CV_FONT_HERSHEY_PLAIN, 1, 1, &baseline);
+		VideoCapture cap(results.paths[video]);
+		Mat frame;
+		
+		cap.set(CV_CAP_PROP_POS_FRAMES, frameid);
+		cap.read(frame);
+		
+		// Frames of videos of another size are scaled to the query's
+		if (!frame.empty() && (frame.cols != fwidth || frame.rows != fheight))
+			resize(frame, frame, Size(fwidth, fheight));
+		
+		if (!frame.empty()) {
+			Mat roi = combined(Rect(x + (width - fwidth)/2, y, fwidth, fheight));
+			frame.copyTo(roi);
+		}
 		
-		putText(combined, line1, Point(x + (width - textsize1.width)/2, y + height + 1*(5 + textsize1.height)), CV_FONT_HERSHEY_PLAIN, 1, Scalar(0,0,0));
-		putText(combined, line2, Point(x + (width - textsize2.width)/2, y + height + 2*(5 + textsize2.height)), CV_FONT_HERSHEY_PLAIN, 1, Scalar(0,0,0));
-		putText(combined, line3, Point(x + (width - textsize3.width)/2, y + height + 3*(5 + textsize3.height)), CV_FONT_HERSHEY_PLAIN, 1, Scalar(0,0,0));
+		// Write the match data, centering each line
+		for (size_t line = 0; line < captions.size(); line++) {
+			int baseline;
+			Size textsize = getTextSize(captions[line], CV_FONT_HERSHEY_PLAIN, 1, 1, &baseline);
+			
+			putText(combined, captions[line], Point(x + (width - textsize.width)/2, y + height + (line + 1)*(5 + textsize.height)), CV_FONT_HERSHEY_PLAIN, 1, Scalar(0,0,0));
+		}
 	}
 	
-	imwrite(filename + ".jpg", combined);
-	cout << "[*] Wrote frame matches and scores to " << filename << ".jpg" << endl;
+	if (write) {
+		imwrite(filename + ".jpg", combined);
+		LOG(LOG_INFO) << "[*] Wrote frame matches and scores to " << filename << ".jpg";
+	}
 	
-	namedWindow("Task 3");
-	imshow("Task 3", combined);
-	waitKey(0);
-	destroyWindow("Task 3");
+	if (show) {
+		namedWindow("Task 3");
+		imshow("Task 3", combined);
+		waitKey(0);
+		destroyWindow("Task 3");
+	}
 }
 
 int main(int argc, const char * argv[]) {
 	string path, filename, videoname;
 	int frameid, n, m;
 	
-	Mat frame, ychan;
-	
 	int width, height;
-	int findex, fcount;
+	int choice;
+	
+	// Previously computed features, keyed by the video and the feature
+	// parameters, so that asking for the same features again is quick
+	string cacheDirectory = FeatureCache::defaultDirectory();
+	size_t cacheSize = FeatureCache::defaultCapacity();
+	bool useCache = true;
+	MatchOptions matchOptions;
+	
+	// Match against every video in the folder rather than just the query's
+	bool corpusMode = false;
+	
+	// Match many frames at once instead of the query frame, writing the
+	// matches to a file rather than showing them
+	string queryFrames;
+	
+	// Given all of the path, file name, feature type, query frames, n and m
+	// as arguments, run once without prompting, write the matches to the
+	// standard output in outputFormat, and only show them or write the
+	// contact sheet if asked to
+	vector<string> args;
+	string outputFormat = "csv";
+	bool showMatches = false;
+	bool writeContactSheet = false;
 	
-	cout << "Enter the path of the folder containing the videos: ";
-	cin >> path;
+	// The size of the blocks of the block features (see block-transform.hpp)
+	int blockSize = 8;
 	
-	// Obtain the filename the user wants to operate on in this run
-	cout << "Enter video file name: ";
-	cin >> filename;
-	videoname = removeExtension(filename);
+	// The frames whose features are matched, every frame by default
+	FrameSelection frames;
 	
-	// Obtain the query frame id
-	cout << "Enter the index of query frame: ";
-	cin >> frameid;
+	// Decode the Y components with libav (see luma-decoder.hpp)
+	bool directDecode = false;
 	
-	// Obtain the n and m parameters
-	cout << "Enter the value of n: ";
-	cin >> n;
-	cout << "Enter the value of m: ";
-	cin >> m;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		
+		if (arg == "--no-cache")
+			useCache = false;
+		else if (arg == "--cache-dir" && i + 1 < argc)
+			cacheDirectory = argv[++i];
+		else if (arg == "--cache-size" && i + 1 < argc)
+			cacheSize = (size_t)atol(argv[++i]) << 20;
+		else if (arg == "--index")
+			matchOptions.useIndex = true;
+		else if (arg == "--index-lists" && i + 1 < argc) {
+			matchOptions.useIndex = true;
+			matchOptions.lists = atoi(argv[++i]);
+		}
+		else if (arg == "--probes" && i + 1 < argc)
+			matchOptions.probes = atoi(argv[++i]);
+		else if (arg == "--pq" && i + 1 < argc)
+			matchOptions.pqSubvectors = atoi(argv[++i]);
+		else if (arg == "--rerank" && i + 1 < argc)
+			matchOptions.rerank = atoi(argv[++i]);
+		else if (arg == "--recall")
+			matchOptions.reportRecall = true;
+		else if (arg == "--corpus")
+			corpusMode = true;
+		else if (arg == "--queries" && i + 1 < argc)
+			queryFrames = argv[++i];
+		else if ((arg == "-k" || arg == "--matches") && i + 1 < argc)
+			matchOptions.nummatches = max(atoi(argv[++i]), 0);
+		else if (arg == "--format" && i + 1 < argc)
+			outputFormat = argv[++i];
+		else if (arg == "--display")
+			showMatches = true;
+		else if (arg == "--contact-sheet")
+			writeContactSheet = true;
+		else if (arg == "--block-size" && i + 1 < argc)
+			blockSize = atoi(argv[++i]);
+		else if (arg == "--start" && i + 1 < argc)
+			frames.start = atoi(argv[++i]);
+		else if (arg == "--end" && i + 1 < argc)
+			frames.end = atoi(argv[++i]);
+		else if (arg == "--stride" && i + 1 < argc)
+			frames.stride = atoi(argv[++i]);
+		else if (arg == "--direct-decode")
+			directDecode = true;
+		else if (arg == "--keyframes-only") {
+			// Only the direct decoder can tell keyframes apart
+			frames.keyframesOnly = true;
+			directDecode = true;
+		}
+		else
+			args.push_back(arg);
+	}
+	
+	bool has_input = args.size() == 6;
+	
+	if (outputFormat != "csv" && outputFormat != "json" && outputFormat != "text") {
+		LOG(LOG_ERROR) << "[*] ERROR: Unknown output format " << outputFormat << ", expected csv, json or text.";
+		return -1;
+	}
+	
+	if (!isSupportedBlockSize(blockSize)) {
+		LOG(LOG_ERROR) << "[*] ERROR: Unsupported block size " << blockSize << ", expected 4, 8, 16 or 32.";
+		return -1;
+	}
+	
+	FeatureCache cache(cacheDirectory, cacheSize);
+	
+	if (!useCache)
+		cache.disable();
+	
+	if (has_input) {
+		path = args[0];
+		filename = args[1];
+		videoname = removeExtension(filename);
+		queryFrames = args[3];
+		
+		if (!parseInteger(args[2], choice) || !parseInteger(args[4], n) || !parseInteger(args[5], m)) {
+			LOG(LOG_ERROR) << "[*] ERROR: Usage: task3 [options] PATH VIDEO FEATURE-TYPE QUERY-FRAMES N M";
+			return -1;
+		}
+	}
+	else {
+		cout << "Enter the path of the folder containing the videos: ";
+		cin >> path;
+		
+		// Obtain the filename the user wants to operate on in this run
+		cout << "Enter video file name: ";
+		cin >> filename;
+		videoname = removeExtension(filename);
+		
+		// Obtain the query frame id
+		cout << "Enter the index of query frame: ";
+		cin >> frameid;
+		
+		// Obtain the n and m parameters
+		cout << "Enter the value of n: ";
+		cin >> n;
+		cout << "Enter the value of m: ";
+		cin >> m;
+		
+		// Matches are shown, and the contact sheet written, unless many
+		// frames are matched at once
+		showMatches = writeContactSheet = queryFrames.empty();
+	}
 	
 	// Open a capture object to the video
 	VideoCapture cap(path + "/" + filename);
 	if (!cap.isOpened()) {
-		cout << endl << "[*] ERROR: Couldn't open the video for processing. Exiting." << endl;
+		LOG(LOG_ERROR) << "[*] ERROR: Couldn't open the video for processing. Exiting.";
 		return -1;
 	}
 	
-	fcount = cap.get(CV_CAP_PROP_FRAME_COUNT);
 	width = cap.get(CV_CAP_PROP_FRAME_WIDTH);
 	height = cap.get(CV_CAP_PROP_FRAME_HEIGHT);
 	
-	int choice;
-	string command, featurefilename;
-	Mat features;
-	vector<frame_match> matches;
+	// Compute the features in memory. Their extraction is quieted to errors
+	// below, without the progress messages of Task 1 and Task 2.
+	ExtractionOptions options;
+	options.writeOutputFile = false;
+	options.blockSize = blockSize;
+	options.frames = frames;
+	options.videoPath = path + "/" + filename;
+	options.directDecode = directDecode;
+	
+	if (!canSelectFrames(options)) {
+		LOG(LOG_ERROR) << "[*] ERROR: Can't select the frames: expected 0 <= --start < --end and --stride >= 1, and --keyframes-only needs a build with libav (-DWITH_LIBAV=ON, see luma-decoder.hpp). Exiting.";
+		return -1;
+	}
+	
+	// The workers that scan the features for matches
+	ThreadPool pool(options.threads);
 	
 	do {
-		// Obtain the choice of sub-task
-		cout << endl << "Feature types: " << endl;
-		cout << "    1. Block histogram" << endl;
-		cout << "    2. Block 2D-DCT" << endl;
-		cout << "    3. Block 2D-DWT" << endl;
-		cout << "    4. Block difference histogram" << endl;
-		cout << "    5. Frame 2D-DWT" << endl;
-		cout << "    6. Exit" << endl;
-		cout << "Enter the feature type to analyze: ";
-		cin >> choice;
-		cout << endl;
-		
-		switch (choice) {
-			case 1:
-			case 2:
-			case 3:
-			case 4:
-				command = "./task1 \"" + path + "\" \"" + filename + "\" " + to_string(choice) + " " + to_string(n);
-				featurefilename = executeTask(command);
-				features = extractTask1Features(choice, featurefilename, fcount, width/8, height/8, n);
-				matches = findMatchingFrames(features, frameid, 10);
-				break;
+		if (!has_input) {
+			// Obtain the choice of sub-task
+			cout << endl << "Feature types: " << endl;
+			cout << "    1. Block histogram" << endl;
+			cout << "    2. Block 2D-DCT" << endl;
+			cout << "    3. Block 2D-DWT" << endl;
+			cout << "    4. Block difference histogram" << endl;
+			cout << "    5. Frame 2D-DWT" << endl;
+			cout << "    6. Exit" << endl;
+			cout << "Enter the feature type to analyze: ";
+			cin >> choice;
+			cout << endl;
 			
-			case 5:
-				command = "./task2 \"" + path + "\" \"" + filename + "\" " + to_string(m); 
-				featurefilename = executeTask(command);
-				features = extractTask2Features(featurefilename, fcount, m);
-				matches = findMatchingFrames(features, frameid, 10);
-				break;
-				
-			case 6:
+			if (choice == 6 || !cin)
 				return 0;
 		}
 		
-		displayMatches(featurefilename, cap, width, height, frameid, matches);
+		if (choice < 1 || choice > 5) {
+			if (has_input) {
+				LOG(LOG_ERROR) << "[*] ERROR: Unknown feature type " << choice << ". Exiting.";
+				return -1;
+			}
+			
+			continue;
+		}
+		
+		// n for the Task 1 features, m for the Task 2 ones
+		int parameter = choice == 5 ? m : n;
+		
+		// The query frames, by row: only the frames with features can be
+		// queried
+		string queryText = queryFrames.empty() ? to_string(frameid) : queryFrames;
+		vector<int> frameids;
+		
+		MatchResults results;
+		string featurefilename;
+		
+		if (corpusMode) {
+			// Match against every video in the folder. The features of each
+			// are computed once, then read from the cache.
+			FeatureCorpus corpus(cache, options);
+			
+			{
+				ScopedLogLevel quiet(LOG_ERROR);
+				corpus.addDirectory(path, choice, parameter);
+			}
+			
+			int video = corpus.find(filename);
+			
+			if (video < 0) {
+				LOG(LOG_ERROR) << "[*] ERROR: Couldn't compute the features of " << filename << ".";
+				
+				if (has_input)
+					return -1;
+				
+				continue;
+			}
+			
+			if (!parseQueryFrames(queryText, corpus.video(video), frameids)) {
+				LOG(LOG_ERROR) << "[*] ERROR: Expected the query frames as frame numbers with features, ranges FIRST-LAST or all, separated by commas.";
+				
+				if (has_input)
+					return -1;
+				
+				continue;
+			}
+			
+			results = matchCorpusFrames(corpus, video, frameids, pool, matchOptions);
+			featurefilename = corpus.video(video).featurefilename + "_corpus";
+		}
+		else {
+			VideoFeatures video;
+			bool loaded;
+			
+			{
+				ScopedLogLevel quiet(LOG_ERROR);
+				loaded = loadVideoFeatures(path, filename, choice, parameter, cache, options, video);
+			}
+			
+			if (!loaded) {
+				LOG(LOG_ERROR) << "[*] ERROR: Couldn't compute the features of " << filename << ".";
+				
+				if (has_input)
+					return -1;
+				
+				continue;
+			}
+			
+			if (!parseQueryFrames(queryText, video, frameids)) {
+				LOG(LOG_ERROR) << "[*] ERROR: Expected the query frames as frame numbers with features, ranges FIRST-LAST or all, separated by commas.";
+				
+				if (has_input)
+					return -1;
+				
+				continue;
+			}
+			
+			results = matchVideoFrames(video, frameids, cache, pool, matchOptions);
+			featurefilename = video.featurefilename;
+		}
+		
+		if (has_input) {
+			writeMatches(cout, outputFormat, results);
+		}
+		else if (!queryFrames.empty()) {
+			ofstream csv(featurefilename + "_matches.csv");
+			writeMatches(csv, "csv", results);
+			cout << "[*] Wrote the matches to " << featurefilename << "_matches.csv" << endl;
+		}
+		else {
+			writeMatches(cout, "text", results);
+		}
+		
+		for (size_t q = 0; q < results.queries.size() && (showMatches || writeContactSheet); q++) {
+			string sheetname = featurefilename;
+			
+			if (results.queries.size() > 1)
+				sheetname += "_" + to_string(results.queries[q]);
+			
+			displayMatches(sheetname, width, height, results, q, writeContactSheet, showMatches);
+		}
 	}
-	while (choice != 6);
+	while (!has_input);
 	
     return 0;
 }
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include "block-dct.hpp"
+#include "cpu-features.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * Checks that the table, float and fixed DCT kernels (see block-dct.hpp)
+ * give exactly the same coefficients as blockDCTReference.
+ *
+ * The blocks are the 8x8 blocks of the Y components of the videos in a
+ * directory, normalized as DCTProcessor does, and a set of synthetic blocks:
+ * random ones, smooth gradients, flat ones and checkerboards at the ends of
+ * the range. The synthetic blocks are always checked, so the test still
+ * means something where no video can be decoded. The float kernel is checked
+ * both with and without AVX2, when the CPU has it.
+ *
+ * Usage:
+ *
+ *   test-block-dct [video directory] [frames per video]
+ *
+ * Exits with 0 if every kernel agreed on every block.
+ */
+
+struct KernelCheck {
+	const char *name;
+	DCTKernel kernel;
+	bool simd;
+	long long blocks;
+	long long mismatches;
+};
+
+static vector<KernelCheck> checks;
+
+static void checkBlock(const int f[8][8]) {
+	int expected[8][8];
+	int F[8][8];
+
+	blockDCTReference(f, expected);
+
+	for (size_t k = 0; k < checks.size(); k++) {
+		KernelCheck &check = checks[k];
+
+		simdAllowed() = check.simd;
+
+		// The single block and the batch entry points dispatch separately
+		blockDCT(check.kernel, f, F);
+		bool same = memcmp(F, expected, sizeof(F)) == 0;
+
+		blockDCTBatch(check.kernel, (const int (*)[8][8])f, (int (*)[8][8])F, 1);
+		same = same && memcmp(F, expected, sizeof(F)) == 0;
+
+		if (!same && check.mismatches++ == 0) {
+			int k = 0;
+
+			while (k < 63 && F[k / 8][k % 8] == expected[k / 8][k % 8]) {
+				k++;
+			}
+
+			cout << "[*] " << check.name << ": first mismatch at F(" << k / 8 << "," << k % 8 << ") = " << F[k / 8][k % 8] << ", expected " << expected[k / 8][k % 8] << endl;
+		}
+
+		check.blocks++;
+	}
+
+	simdAllowed() = true;
+}
+
+static long long checkVideo(string path, int maxFrames) {
+	VideoCapture capture(path);
+	Mat frame;
+	Mat ychan;
+	int f[8][8];
+	long long blocks = 0;
+
+	if (!capture.isOpened())
+		return 0;
+
+	for (int n = 0; (maxFrames <= 0 || n < maxFrames) && capture.read(frame); n++) {
+		cvtColor(frame, ychan, CV_BGR2GRAY);
+
+		for (int y = 0; y + 8 <= ychan.rows; y += 8) {
+			for (int x = 0; x + 8 <= ychan.cols; x += 8) {
+				// Normalized from [0, 255] to [-128, 127], as DCTProcessor does
+				for (int i = 0; i < 8; i++) {
+					const uchar *row = ychan.ptr<uchar>(y + i) + x;
+
+					for (int j = 0; j < 8; j++) {
+						f[i][j] = row[j] - 128;
+					}
+				}
+
+				checkBlock(f);
+				blocks++;
+			}
+		}
+	}
+
+	return blocks;
+}
+
+static long long checkVideos(string directory, int maxFrames) {
+	DIR *listing = opendir(directory.c_str());
+	long long blocks = 0;
+
+	if (listing == NULL)
+		return 0;
+
+	while (struct dirent *item = readdir(listing)) {
+		string name = item->d_name;
+		string path = directory + "/" + name;
+		struct stat info;
+
+		if (name[0] == '.' || stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+			continue;
+
+		long long checked = checkVideo(path, maxFrames);
+
+		if (checked > 0)
+			cout << "[*] " << path << ": " << checked << " blocks" << endl;
+
+		blocks += checked;
+	}
+
+	closedir(listing);
+	return blocks;
+}
+
+static long long checkSynthetic(int randomBlocks) {
+	// A fixed linear congruential generator, so failures are reproducible
+	uint32_t state = 12345;
+	int f[8][8];
+	long long blocks = 0;
+
+	for (int n = 0; n < randomBlocks; n++) {
+		for (int i = 0; i < 8; i++) {
+			for (int j = 0; j < 8; j++) {
+				state = state * 1664525u + 1013904223u;
+				f[i][j] = (int)(state >> 24) - 128;
+			}
+		}
+
+		checkBlock(f);
+		blocks++;
+	}
+
+	// Gradients, in the range and direction of every step
+	for (int base = -128; base < 128; base += 5) {
+		for (int dx = -16; dx <= 16; dx++) {
+			for (int dy = -16; dy <= 16; dy += 4) {
+				for (int i = 0; i < 8; i++) {
+					for (int j = 0; j < 8; j++) {
+						f[i][j] = max(-128, min(127, base + dx*j + dy*i));
+					}
+				}
+
+				checkBlock(f);
+				blocks++;
+			}
+		}
+	}
+
+	// Flat blocks and checkerboards, where exact halves are most likely
+	for (int value = -128; value < 128; value++) {
+		for (int i = 0; i < 8; i++) {
+			for (int j = 0; j < 8; j++) {
+				f[i][j] = value;
+			}
+		}
+
+		checkBlock(f);
+
+		for (int i = 0; i < 8; i++) {
+			for (int j = 0; j < 8; j++) {
+				f[i][j] = (i + j) % 2 == 0 ? value : -1 - value;
+			}
+		}
+
+		checkBlock(f);
+		blocks += 2;
+	}
+
+	return blocks;
+}
+
+int main(int argc, char *argv[]) {
+	string directory = argc > 1 ? argv[1] : "";
+	int maxFrames = argc > 2 ? atoi(argv[2]) : 0;
+
+	checks.push_back({"table", DCT_KERNEL_TABLE, true, 0, 0});
+	checks.push_back({"float", DCT_KERNEL_FLOAT, false, 0, 0});
+	checks.push_back({"fixed", DCT_KERNEL_FIXED, true, 0, 0});
+
+	if (useAVX2())
+		checks.push_back({"float (AVX2)", DCT_KERNEL_FLOAT, true, 0, 0});
+
+	long long videoBlocks = directory.empty() ? 0 : checkVideos(directory, maxFrames);
+
+	if (videoBlocks == 0)
+		cout << "[*] No video blocks to check" << (directory.empty() ? "" : " in " + directory) << ", synthetic blocks only" << endl;
+
+	long long syntheticBlocks = checkSynthetic(200000);
+	bool passed = true;
+
+	cout << "[*] Checked " << videoBlocks << " video and " << syntheticBlocks << " synthetic blocks" << endl;
+
+	for (size_t k = 0; k < checks.size(); k++) {
+		cout << "[*] " << checks[k].name << ": " << checks[k].mismatches << " of " << checks[k].blocks << " blocks differ" << endl;
+		passed = passed && checks[k].mismatches == 0;
+	}
+
+	return passed ? 0 : 1;
+}
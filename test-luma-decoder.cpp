@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include "luma-decoder.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * Checks the frames of LumaDecoder against those of a capture converted to
+ * grayscale, as the tasks read them without direct decoding (see
+ * luma-decoder.hpp):
+ *
+ *   - both give the same number of frames, numbered 0, 1, 2 and so on,
+ *   - of the same size,
+ *   - whose Y values differ by at most maxDifference, except where the
+ *     capture's BGR values clip,
+ *   - and a seek() to the middle of the video continues with the frame the
+ *     capture has there.
+ *
+ * Usage:
+ *
+ *   test-luma-decoder <video directory>
+ *
+ * Exits with 0 if every video of the directory was decoded directly and
+ * agreed with the capture. Only built with libav (WITH_LIBAV).
+ */
+
+static const int maxDifference = 2;
+
+// The largest difference between the Y values of a frame, over the pixels
+// whose BGR values don't clip
+static int frameDifference(const Mat &bgr, const Mat &ychan, const Mat &direct) {
+	int largest = 0;
+
+	for (int i = 0; i < ychan.rows; i++) {
+		const uchar *colour = bgr.ptr<uchar>(i);
+		const uchar *y = ychan.ptr<uchar>(i);
+		const uchar *d = direct.ptr<uchar>(i);
+
+		for (int j = 0; j < ychan.cols; j++) {
+			const uchar *p = colour + 3*j;
+
+			if (*min_element(p, p + 3) == 0 || *max_element(p, p + 3) == 255)
+				continue;
+
+			largest = max(largest, abs(y[j] - d[j]));
+		}
+	}
+
+	return largest;
+}
+
+static bool sameFrame(const Mat &bgr, const Mat &direct, int frameIndex, string path) {
+	Mat ychan;
+
+	cvtColor(bgr, ychan, CV_BGR2GRAY);
+
+	if (direct.rows != ychan.rows || direct.cols != ychan.cols || direct.type() != CV_8UC1) {
+		cout << "[*] " << path << ": frame " << frameIndex << " is " << direct.cols << " x " << direct.rows << ", expected " << ychan.cols << " x " << ychan.rows << endl;
+		return false;
+	}
+
+	int difference = frameDifference(bgr, ychan, direct);
+
+	if (difference > maxDifference) {
+		cout << "[*] " << path << ": frame " << frameIndex << " differs by " << difference << " levels" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+static bool checkVideo(string path) {
+	VideoCapture capture(path);
+	LumaDecoder decoder;
+	Mat bgr, direct;
+	int frames = 0;
+
+	if (!capture.isOpened() || !decoder.open(path)) {
+		cout << "[*] " << path << ": couldn't be decoded directly" << endl;
+		return false;
+	}
+
+	// Every frame, in order
+	while (capture.read(bgr)) {
+		if (!decoder.read(direct)) {
+			cout << "[*] " << path << ": the decoder stopped after " << frames << " frames" << endl;
+			return false;
+		}
+
+		if (decoder.frameNumber() != frames) {
+			cout << "[*] " << path << ": frame " << frames << " is numbered " << decoder.frameNumber() << endl;
+			return false;
+		}
+
+		if (!sameFrame(bgr, direct, frames, path))
+			return false;
+
+		frames++;
+	}
+
+	if (decoder.read(direct)) {
+		cout << "[*] " << path << ": the decoder has more than the capture's " << frames << " frames" << endl;
+		return false;
+	}
+
+	// Continuing from the middle
+	int middle = frames / 2;
+	VideoCapture again(path);
+
+	for (int n = 0; n <= middle; n++) {
+		again.read(bgr);
+	}
+
+	if (!decoder.seek(middle) || !decoder.read(direct) || decoder.frameNumber() != middle) {
+		cout << "[*] " << path << ": couldn't seek to frame " << middle << endl;
+		return false;
+	}
+
+	if (!sameFrame(bgr, direct, middle, path))
+		return false;
+
+	cout << "[*] " << path << ": " << frames << " frames agree" << endl;
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		cout << "[*] Usage: test-luma-decoder <video directory>" << endl;
+		return 1;
+	}
+
+	string directory = argv[1];
+	DIR *listing = opendir(directory.c_str());
+	int videos = 0;
+	bool passed = true;
+
+	if (listing == NULL) {
+		cout << "[*] Couldn't list " << directory << endl;
+		return 1;
+	}
+
+	while (struct dirent *item = readdir(listing)) {
+		string name = item->d_name;
+		string path = directory + "/" + name;
+		struct stat info;
+
+		if (name[0] == '.' || stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+			continue;
+
+		passed = checkVideo(path) && passed;
+		videos++;
+	}
+
+	closedir(listing);
+
+	if (videos == 0) {
+		cout << "[*] No videos in " << directory << endl;
+		return 1;
+	}
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+ * A fixed-size pool of worker threads.
+ *
+ * Tasks are run in the order they are submitted, on whichever worker is free.
+ * submit() returns a future for the task's result, so callers that need their
+ * results in a fixed order (for example, to write output files that are
+ * identical to a single-threaded run) simply wait on the futures in order.
+ */
+class ThreadPool {
+
+	public:
+		ThreadPool(int threads) {
+			_stopping = false;
+
+			for (int i = 0; i < max(threads, 1); i++)
+				_workers.push_back(thread(&ThreadPool::work, this));
+		}
+
+		~ThreadPool() {
+			{
+				lock_guard<mutex> lock(_mutex);
+				_stopping = true;
+			}
+
+			_ready.notify_all();
+
+			for (size_t i = 0; i < _workers.size(); i++)
+				_workers[i].join();
+		}
+
+		int size() const {
+			return (int)_workers.size();
+		}
+
+		template <typename F>
+		future<typename result_of<F()>::type> submit(F task) {
+			typedef typename result_of<F()>::type R;
+
+			// packaged_task cannot be copied, but function<> requires it
+			shared_ptr<packaged_task<R()>> packaged = make_shared<packaged_task<R()>>(task);
+			future<R> result = packaged->get_future();
+
+			{
+				lock_guard<mutex> lock(_mutex);
+				_tasks.push([packaged]() { (*packaged)(); });
+			}
+
+			_ready.notify_one();
+
+			return result;
+		}
+
+		// The number of workers to use when none was asked for
+		static int defaultSize() {
+			return max((int)thread::hardware_concurrency(), 1);
+		}
+
+	protected:
+		void work() {
+			while (true) {
+				function<void()> task;
+
+				{
+					unique_lock<mutex> lock(_mutex);
+					_ready.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+
+					if (_stopping && _tasks.empty())
+						return;
+
+					task = move(_tasks.front());
+					_tasks.pop();
+				}
+
+				task();
+			}
+		}
+
+		vector<thread> _workers;
+		queue<function<void()>> _tasks;
+		mutex _mutex;
+		condition_variable _ready;
+		bool _stopping;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef TOP_K_HPP
+#define TOP_K_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+ * The k candidates with the smallest scores seen so far, in a bounded
+ * max-heap: the root is the worst of the k, so a candidate is kept in
+ * O(log k) by replacing it, and rejected in O(1) when it is no better.
+ *
+ * threshold() is the score a candidate has to beat to be kept. It is
+ * infinite until k candidates have been seen, and minus infinity if k is 0.
+ * Searches use it to give up on a candidate as soon as its partial score
+ * exceeds it.
+ *
+ * Equal scores are ordered by id, so the result doesn't depend on the order
+ * the candidates were pushed in.
+ */
+template <typename Score, typename Id = int>
+class TopK {
+
+	public:
+		typedef pair<Id, Score> Entry;
+
+		TopK(size_t k) {
+			_k = k;
+			_heap.reserve(k);
+		}
+
+		size_t capacity() const {
+			return _k;
+		}
+
+		size_t size() const {
+			return _heap.size();
+		}
+
+		Score threshold() const {
+			// Nothing is kept
+			if (_k == 0)
+				return numeric_limits<Score>::has_infinity ? -numeric_limits<Score>::infinity() : numeric_limits<Score>::lowest();
+
+			if (_heap.size() < _k)
+				return numeric_limits<Score>::has_infinity ? numeric_limits<Score>::infinity() : numeric_limits<Score>::max();
+
+			return _heap.front().second;
+		}
+
+		// Returns true if the candidate is one of the k best so far
+		bool push(Id id, Score score) {
+			Entry entry(id, score);
+
+			if (_k == 0)
+				return false;
+
+			if (_heap.size() < _k) {
+				_heap.push_back(entry);
+				push_heap(_heap.begin(), _heap.end(), better);
+				return true;
+			}
+
+			if (!better(entry, _heap.front()))
+				return false;
+
+			pop_heap(_heap.begin(), _heap.end(), better);
+			_heap.back() = entry;
+			push_heap(_heap.begin(), _heap.end(), better);
+
+			return true;
+		}
+
+		// Keep the k best of both
+		void merge(const TopK &other) {
+			for (size_t i = 0; i < other._heap.size(); i++) {
+				push(other._heap[i].first, other._heap[i].second);
+			}
+		}
+
+		// The candidates kept, best first
+		vector<Entry> sorted() const {
+			vector<Entry> entries = _heap;
+			sort_heap(entries.begin(), entries.end(), better);
+			return entries;
+		}
+
+	protected:
+		// The heap's comparison: a before b if a is the better candidate, so
+		// the worst is at the root
+		static bool better(const Entry &a, const Entry &b) {
+			return a.second < b.second || (a.second == b.second && a.first < b.first);
+		}
+
+		size_t _k;
+		vector<Entry> _heap;
+};
+
+#endif
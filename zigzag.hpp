@@ -0,0 +1,146 @@
+#ifndef ZIGZAG_HPP
+#define ZIGZAG_HPP
+
+#include <cmath>
+#include <cstddef>
+#include "opencv2/core/core.hpp"
+
+using namespace cv;
+using namespace std;
+
+/*
+ * The zigzag scan of an NxN block of coefficients, for N = 4, 8, 16 and 32:
+ * the order in which the DCT, the block DWT and the frame DWT keep their most
+ * significant components.
+ *
+ * The scan walks the anti-diagonals d = u + v from the top-left corner,
+ * bottom-left to top-right on the even ones and top-right to bottom-left on
+ * the odd ones:
+ *
+ *     0  1  5  6
+ *     2  4  7 12
+ *     3  8 11 13
+ *     9 10 14 15
+ *
+ * Zigzag<N>::entries holds the (row, column) of every entry in scan order.
+ * The table is generated at compile time, so keeping the first n components
+ * of a block is a straight gather of its first n entries.
+ *
+ * The first entries of the scans of different sizes agree only up to the
+ * first diagonal they don't share, so a feature must always be read with the
+ * table it was written with.
+ */
+
+struct ZigzagEntry {
+	unsigned char row;
+	unsigned char column;
+};
+
+// The length of diagonal d of an NxN block
+constexpr int zigzagDiagonalLength(int size, int d) {
+	return d < size ? d + 1 : 2*size - 1 - d;
+}
+
+// The diagonal of entry k, and its place along that diagonal, counting
+// diagonals from d
+constexpr int zigzagDiagonal(int size, int k, int d = 0) {
+	return k < zigzagDiagonalLength(size, d) ? d : zigzagDiagonal(size, k - zigzagDiagonalLength(size, d), d + 1);
+}
+
+constexpr int zigzagStep(int size, int k, int d = 0) {
+	return k < zigzagDiagonalLength(size, d) ? k : zigzagStep(size, k - zigzagDiagonalLength(size, d), d + 1);
+}
+
+// The distance of entry k from the left edge (even diagonals) or the top
+// edge (odd diagonals) of the block
+constexpr int zigzagOffset(int size, int k) {
+	return (zigzagDiagonal(size, k) < size ? 0 : zigzagDiagonal(size, k) - size + 1) + zigzagStep(size, k);
+}
+
+constexpr int zigzagRow(int size, int k) {
+	return zigzagDiagonal(size, k) % 2 == 0 ? zigzagDiagonal(size, k) - zigzagOffset(size, k) : zigzagOffset(size, k);
+}
+
+constexpr int zigzagColumn(int size, int k) {
+	return zigzagDiagonal(size, k) % 2 == 0 ? zigzagOffset(size, k) : zigzagDiagonal(size, k) - zigzagOffset(size, k);
+}
+
+static_assert(zigzagRow(4, 3) == 2 && zigzagColumn(4, 3) == 0, "zigzag: bad third diagonal");
+static_assert(zigzagRow(8, 36) == 7 && zigzagColumn(8, 36) == 1, "zigzag: bad first short diagonal");
+static_assert(zigzagRow(32, 1023) == 31 && zigzagColumn(32, 1023) == 31, "zigzag: bad last entry");
+
+// The indices 0 to Count - 1 as a parameter pack, built by halves so the
+// template nesting stays logarithmic
+template <int... I>
+struct ZigzagIndices {
+};
+
+template <typename First, typename Second>
+struct ZigzagConcat;
+
+template <int... First, int... Second>
+struct ZigzagConcat<ZigzagIndices<First...>, ZigzagIndices<Second...>> {
+	typedef ZigzagIndices<First..., ((int)sizeof...(First) + Second)...> type;
+};
+
+template <int Count>
+struct ZigzagRange {
+	typedef typename ZigzagConcat<typename ZigzagRange<Count / 2>::type, typename ZigzagRange<Count - Count / 2>::type>::type type;
+};
+
+template <>
+struct ZigzagRange<0> {
+	typedef ZigzagIndices<> type;
+};
+
+template <>
+struct ZigzagRange<1> {
+	typedef ZigzagIndices<0> type;
+};
+
+template <int N, typename = typename ZigzagRange<N * N>::type>
+struct Zigzag;
+
+template <int N, int... K>
+struct Zigzag<N, ZigzagIndices<K...>> {
+	static constexpr ZigzagEntry entries[N * N] = { { zigzagRow(N, K), zigzagColumn(N, K) }... };
+};
+
+template <int N, int... K>
+constexpr ZigzagEntry Zigzag<N, ZigzagIndices<K...>>::entries[N * N];
+
+// Coefficients as components: the DCT's are already rounded integers, the
+// Haar transform's are rounded to the nearest one
+inline short zigzagComponent(int coefficient) {
+	return (short)coefficient;
+}
+
+inline short zigzagComponent(float coefficient) {
+	return saturate_cast<short>(round(coefficient));
+}
+
+// The first n (at most N*N) components of the zigzag scan of the top-left NxN
+// corner of data, whose rows are stride elements apart
+template <int N, typename T>
+inline void zigzagGather(const T *data, size_t stride, int n, short *components) {
+	const ZigzagEntry *entries = Zigzag<N>::entries;
+
+	for (int k = 0; k < n; k++) {
+		components[k] = zigzagComponent(data[entries[k].row * stride + entries[k].column]);
+	}
+}
+
+// The same for a corner size only known at run time. Returns false if there
+// is no table of that size.
+template <typename T>
+inline bool zigzagGather(const T *data, size_t stride, int size, int n, short *components) {
+	switch (size) {
+		case 4:  zigzagGather<4>(data, stride, n, components);  return true;
+		case 8:  zigzagGather<8>(data, stride, n, components);  return true;
+		case 16: zigzagGather<16>(data, stride, n, components); return true;
+		case 32: zigzagGather<32>(data, stride, n, components); return true;
+		default: return false;
+	}
+}
+
+#endif